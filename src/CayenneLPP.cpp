@@ -6,8 +6,11 @@
 #include "CayenneLPP.h"
 
 #ifndef ARDUINO
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <iterator>
+#include "CayenneLPPText.h"
 #endif
 
 // ----------------------------------------------------------------------------
@@ -133,6 +136,7 @@ bool CayenneLPP::isType(uint8_t type) {
 #endif
 #ifndef ARDUINO
     case LPP_POLYLINE:
+    case LPP_POLYLINE_EXT:
 #endif
       return true;
   }
@@ -790,6 +794,44 @@ uint8_t CayenneLPP::addColour(uint8_t channel, uint8_t r, uint8_t g, uint8_t b)
 }
 #endif
 
+#ifndef CAYENNE_DISABLE_POLYLINE
+uint8_t CayenneLPP::addPolyline(uint8_t channel, const double *latitudes, const double *longitudes, uint16_t count,
+                                uint8_t factor, uint8_t simplification)
+{
+  // check buffer overflow for minimum size
+  if ((_cursor + LPP_MIN_POLYLINE_SIZE + 2) > _maxsize) {
+    _error = LPP_ERROR_OVERFLOW;
+    return 0;
+  }
+
+  // encode coordinates directly behind channel and type
+  CayenneLPPPolylineEncoder encoder;
+  const uint8_t capacity = _maxsize - _cursor - 2;
+  if (!count || !encoder.begin(_buffer + _cursor + 2, capacity, latitudes[0], longitudes[0], factor, simplification)) {
+    _error = LPP_ERROR_INVALID_VALUE;
+    return 0;
+  }
+  for (uint16_t i = 1; i < count; ++i) {
+    if (!encoder.push(latitudes[i], longitudes[i])) {
+      break;
+    }
+  }
+
+  // check buffer overflow for encoded size, a last jump may exceed the capacity
+  const uint32_t size = encoder.finish();
+  if (size > capacity) {
+    _error = LPP_ERROR_OVERFLOW;
+    return 0;
+  }
+
+  _buffer[_cursor++] = channel;
+  _buffer[_cursor++] = LPP_POLYLINE;
+  _cursor += size;
+
+  return _cursor;
+}
+#endif
+
 #ifndef CAYENNE_DISABLE_ACCELEROMETER
 uint8_t CayenneLPP::addAccelerometer(uint8_t channel, float x, float y, float z) {
 
@@ -886,27 +928,93 @@ uint8_t CayenneLPP::addPolyline(uint8_t channel,
       return 0;
     }
 
-    // encode coordinates
-    auto buffer = _polyline.encode(coords, precision, simplification);
+    // encode coordinates directly behind channel and type, fitting simplifications
+    // use the remaining space (the size field is one byte)
+    const uint32_t capacity = _maxsize - _cursor - 2;
+    const uint32_t size = _polyline.encode(coords, precision, simplification,
+                                           _buffer + _cursor + 2, capacity, std::min<uint32_t>(capacity, 255));
 
-    // check buffer overflow for encoded size
-    if ((_cursor + buffer.size() + 2) > _maxsize) {
+    // check buffer overflow for encoded size, a last jump may exceed the size limit
+    if (size > capacity || size > 255) {
       _error = LPP_ERROR_OVERFLOW;
       return 0;
     }
 
     _buffer[_cursor++] = channel;
     _buffer[_cursor++] = LPP_POLYLINE;
-    std::memcpy(_buffer+_cursor, buffer.data(), buffer.size());
-    _cursor += buffer.size();
+    _cursor += size;
+
+    return _cursor;
+}
+
+template <typename Track>
+uint8_t CayenneLPP::addPolylineExtField(uint8_t channel,
+                                        const Track& track,
+                                        CayenneLPPPolyline::Precision precision,
+                                        CayenneLPPPolyline::Simplification simplification) {
+
+    // check buffer overflow for minimum size
+    if ((_cursor + LPP_MIN_POLYLINE_EXT_SIZE + 2) > _maxsize) {
+      _error = LPP_ERROR_OVERFLOW;
+      return 0;
+    }
+
+    const uint32_t capacity = _maxsize - _cursor - 2;
+    const uint32_t size = _polyline.encodeExtended(track, precision, simplification,
+                                                   _buffer + _cursor + 2, capacity, std::min<uint32_t>(capacity, 255));
+
+    // less than two coords, or times or altitudes do not match the coords
+    if (size == 0) {
+      _error = LPP_ERROR_INVALID_VALUE;
+      return 0;
+    }
+
+    // check buffer overflow for encoded size, a last jump may exceed the size limit
+    if (size > capacity || size > 255) {
+      _error = LPP_ERROR_OVERFLOW;
+      return 0;
+    }
+
+    _buffer[_cursor++] = channel;
+    _buffer[_cursor++] = LPP_POLYLINE_EXT;
+    _cursor += size;
 
     return _cursor;
 }
+
+uint8_t CayenneLPP::addPolylineExt(uint8_t channel,
+                                   const std::vector<std::pair<double, double>>& coords,
+                                   CayenneLPPPolyline::Precision precision,
+                                   CayenneLPPPolyline::Simplification simplification) {
+    return addPolylineExtField(channel, coords, precision, simplification);
+}
+
+uint8_t CayenneLPP::addPolylineExt(uint8_t channel,
+                                   const CayenneLPPPolyline::Trajectory& trajectory,
+                                   CayenneLPPPolyline::Precision precision,
+                                   CayenneLPPPolyline::Simplification simplification) {
+    return addPolylineExtField(channel, trajectory, precision, simplification);
+}
+
+uint8_t CayenneLPP::addPolylineExt(uint8_t channel,
+                                   const std::vector<std::vector<std::pair<double, double>>>& segments,
+                                   CayenneLPPPolyline::Precision precision,
+                                   CayenneLPPPolyline::Simplification simplification) {
+    return addPolylineExtField(channel, segments, precision, simplification);
+}
+
+void CayenneLPP::setPolylineBudget(uint32_t operations, uint32_t micros) {
+    _polyline.setSimplificationBudget(operations, micros);
+}
+
+void CayenneLPP::setPolylineFilter(const CayenneLPPPolyline::Filter& filter) {
+    _polyline.setFilter(filter);
+}
 #endif
 
 // ----------------------------------------------------------------------------
 
-float CayenneLPP::getValue(uint8_t * buffer, uint8_t size, uint32_t multiplier, bool is_signed) {
+float CayenneLPP::getValue(const uint8_t * buffer, uint8_t size, uint32_t multiplier, bool is_signed) {
 
     uint32_t value = 0;
     for (uint8_t i=0; i<size; i++) {
@@ -926,7 +1034,7 @@ float CayenneLPP::getValue(uint8_t * buffer, uint8_t size, uint32_t multiplier,
 
 }
 
-uint32_t CayenneLPP::getValue32(uint8_t * buffer, uint8_t size) {
+uint32_t CayenneLPP::getValue32(const uint8_t * buffer, uint8_t size) {
 
     uint32_t value = 0;
     for (uint8_t i=0; i<size; i++) {
@@ -938,7 +1046,7 @@ uint32_t CayenneLPP::getValue32(uint8_t * buffer, uint8_t size) {
 }
 
 #if defined(ARDUINO) || defined(IDF_VER)
-uint8_t CayenneLPP::decode(uint8_t *buffer, uint8_t len, JsonArray& root) {
+uint8_t CayenneLPP::decode(const uint8_t *buffer, uint8_t len, JsonArray& root) {
 
   uint8_t count = 0;
   uint8_t index = 0;
@@ -1037,7 +1145,7 @@ uint8_t CayenneLPP::decode(uint8_t *buffer, uint8_t len, JsonArray& root) {
 
 }
 
-uint8_t CayenneLPP::decodeTTN(uint8_t *buffer, uint8_t len, JsonObject& root) {
+uint8_t CayenneLPP::decodeTTN(const uint8_t *buffer, uint8_t len, JsonObject& root) {
 
   uint8_t count = 0;
   uint8_t index = 0;
@@ -1142,7 +1250,7 @@ uint8_t CayenneLPP::decodeTTN(uint8_t *buffer, uint8_t len, JsonObject& root) {
 #endif
 // Non Arduino frameworks
 #ifndef ARDUINO
-uint8_t CayenneLPP::decode(uint8_t *buffer, uint8_t len, std::map<uint8_t, CayenneLPPMessage> &messageMap) {
+uint8_t CayenneLPP::decode(const uint8_t *buffer, uint8_t len, std::map<uint8_t, CayenneLPPMessage> &messageMap) {
 
   uint8_t count = 0;
   uint8_t index = 0;
@@ -1276,8 +1384,41 @@ uint8_t CayenneLPP::decode(uint8_t *buffer, uint8_t len, std::map<uint8_t, Cayen
 #ifndef ARDUINO
     case LPP_POLYLINE: {
       size = buffer[index];
-      const std::vector<uint8_t> buffer2(&buffer[index], &buffer[index] + size);
-      messageMap[channel].polyline = _polyline.decode(buffer2);
+      if (size < LPP_MIN_POLYLINE_SIZE || index + size > len) {
+        _error = LPP_ERROR_OVERFLOW;
+        return 0;
+      }
+      // decode in place, reusing the storage of a previous polyline
+      auto& polyline = messageMap[channel].polyline;
+      polyline.clear();
+      messageMap[channel].polylineTime.clear();
+      messageMap[channel].polylineAltitude.clear();
+      messageMap[channel].polylineSegments.clear();
+      // unknown factor or first coordinate out of range
+      const uint32_t count = CayenneLPPPolyline::getCount(&buffer[index], size);
+      if (count == 0) {
+        _error = LPP_ERROR_INVALID_VALUE;
+        return 0;
+      }
+      polyline.reserve(count);
+      CayenneLPPPolyline::decode(&buffer[index], size, std::back_inserter(polyline));
+      break;
+    }
+    case LPP_POLYLINE_EXT: {
+      size = buffer[index];
+      if (size < LPP_MIN_POLYLINE_EXT_SIZE || index + size > len) {
+        _error = LPP_ERROR_OVERFLOW;
+        return 0;
+      }
+      // Records cut off by the size byte are a length error, unknown flags or escapes invalid content
+      bool truncated = false;
+      if (!CayenneLPPPolyline::decodeExtended(&buffer[index], size, messageMap[channel].polyline,
+                                              &messageMap[channel].polylineTime,
+                                              &messageMap[channel].polylineAltitude,
+                                              &messageMap[channel].polylineSegments, &truncated)) {
+        _error = truncated ? LPP_ERROR_OVERFLOW : LPP_ERROR_INVALID_VALUE;
+        return 0;
+      }
       break;
     }
 #endif
@@ -1292,5 +1433,33 @@ uint8_t CayenneLPP::decode(uint8_t *buffer, uint8_t len, std::map<uint8_t, Cayen
 
   return count;
 
+}
+
+uint8_t CayenneLPP::decodeBase64(const char *text, size_t length, std::map<uint8_t, CayenneLPPMessage> &messageMap) {
+
+  // Convert straight into a scratch buffer consumed by the parser
+  uint8_t buffer[255];
+  const int size = CayenneLPPText::base64ToBinary(text, length, buffer, sizeof(buffer));
+  if (size < 0) {
+    _error = (length > 4 * ((sizeof(buffer) + 2) / 3)) ? LPP_ERROR_OVERFLOW : LPP_ERROR_INVALID_TEXT;
+    return 0;
+  }
+
+  return decode(buffer, size, messageMap);
+
+}
+
+uint8_t CayenneLPP::decodeHex(const char *text, size_t length, std::map<uint8_t, CayenneLPPMessage> &messageMap) {
+
+  // Convert straight into a scratch buffer consumed by the parser
+  uint8_t buffer[255];
+  const int size = CayenneLPPText::hexToBinary(text, length, buffer, sizeof(buffer));
+  if (size < 0) {
+    _error = (length > 2 * sizeof(buffer)) ? LPP_ERROR_OVERFLOW : LPP_ERROR_INVALID_TEXT;
+    return 0;
+  }
+
+  return decode(buffer, size, messageMap);
+
 }
 #endif
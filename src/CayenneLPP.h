@@ -18,11 +18,13 @@
 #endif
 // Non Arduino frameworks
 #ifndef ARDUINO
+#include <cstddef>
 #include <cstdint>
 #include <map>
 #include "CayenneLPPMessage.h"
 #include "CayenneLPPPolyline.h"
 #endif
+#include "CayenneLPPPolylineEncoder.h"
 
 #define LPP_DIGITAL_INPUT 0         // 1 byte
 #define LPP_DIGITAL_OUTPUT 1        // 1 byte
@@ -51,6 +53,7 @@
 #define LPP_GPS 136                 // 3 byte lon/lat 0.0001 °, 3 bytes alt 0.01 meter
 #define LPP_SWITCH 142              // 1 byte, 0/1
 #define LPP_POLYLINE 240            // 1 byte size, 1 byte delta factor, 3 byte lon/lat 0.0001° * factor, n (size-8) bytes deltas
+#define LPP_POLYLINE_EXT 241        // as LPP_POLYLINE plus 1 byte flags after the factor, deltas with escapes for large jumps
 
 // Only Data Size
 #define LPP_DIGITAL_INPUT_SIZE 1
@@ -80,6 +83,7 @@
 #define LPP_CONCENTRATION_SIZE 2
 #define LPP_COLOUR_SIZE 3
 #define LPP_MIN_POLYLINE_SIZE 8
+#define LPP_MIN_POLYLINE_EXT_SIZE 9
 
 // Multipliers
 #define LPP_DIGITAL_INPUT_MULT 1
@@ -113,6 +117,8 @@
 #define LPP_ERROR_OK 0
 #define LPP_ERROR_OVERFLOW 1
 #define LPP_ERROR_UNKOWN_TYPE 2
+#define LPP_ERROR_INVALID_TEXT 3
+#define LPP_ERROR_INVALID_VALUE 4
 
 class CayenneLPP {
 
@@ -130,12 +136,14 @@ public:
   const char *getTypeName(uint8_t type);
 // Arduino or ESP-IDF framework
 #if defined(ARDUINO) || defined(IDF_VER)
-  uint8_t decode(uint8_t *buffer, uint8_t size, JsonArray &root);
-  uint8_t decodeTTN(uint8_t *buffer, uint8_t size, JsonObject &root);
+  uint8_t decode(const uint8_t *buffer, uint8_t size, JsonArray &root);
+  uint8_t decodeTTN(const uint8_t *buffer, uint8_t size, JsonObject &root);
 #endif
 // Non Arduino frameworks
 #ifndef ARDUINO
-  uint8_t decode(uint8_t *buffer, uint8_t size, std::map<uint8_t, CayenneLPPMessage> &messageMap);
+  uint8_t decode(const uint8_t *buffer, uint8_t size, std::map<uint8_t, CayenneLPPMessage> &messageMap);
+  uint8_t decodeBase64(const char *text, size_t length, std::map<uint8_t, CayenneLPPMessage> &messageMap);
+  uint8_t decodeHex(const char *text, size_t length, std::map<uint8_t, CayenneLPPMessage> &messageMap);
 #endif
 
   // Original LPPv1 data types
@@ -220,11 +228,34 @@ public:
 #ifndef CAYENNE_DISABLE_COLOUR
   uint8_t addColour(uint8_t channel, uint8_t r, uint8_t g, uint8_t b);
 #endif
+#ifndef CAYENNE_DISABLE_POLYLINE
+  // Heap-free, also on Arduino. Simplifies online, see CayenneLPPPolylineEncoder.
+  // The encoder lives on the stack, about 220 bytes on AVR with the default window.
+  uint8_t addPolyline(uint8_t channel, const double *latitudes, const double *longitudes, uint16_t count,
+                      uint8_t factor = CayenneLPPPolylineEncoder::Prec0_0001,
+                      uint8_t simplification = CayenneLPPPolylineEncoder::DouglasPeucker);
+#endif
 #ifndef ARDUINO
   uint8_t addPolyline(uint8_t channel,
                       const std::vector<std::pair<double, double>>& coords,
                       CayenneLPPPolyline::Precision precision = CayenneLPPPolyline::Prec0_0001,
                       CayenneLPPPolyline::Simplification simplification = CayenneLPPPolyline::DouglasPeucker);
+  uint8_t addPolylineExt(uint8_t channel,
+                         const std::vector<std::pair<double, double>>& coords,
+                         CayenneLPPPolyline::Precision precision = CayenneLPPPolyline::Prec0_0001,
+                         CayenneLPPPolyline::Simplification simplification = CayenneLPPPolyline::DouglasPeucker);
+  uint8_t addPolylineExt(uint8_t channel,
+                         const CayenneLPPPolyline::Trajectory& trajectory,
+                         CayenneLPPPolyline::Precision precision = CayenneLPPPolyline::Prec0_0001,
+                         CayenneLPPPolyline::Simplification simplification = CayenneLPPPolyline::SynchronizedDouglasPeucker);
+  uint8_t addPolylineExt(uint8_t channel,
+                         const std::vector<std::vector<std::pair<double, double>>>& segments,
+                         CayenneLPPPolyline::Precision precision = CayenneLPPPolyline::Prec0_0001,
+                         CayenneLPPPolyline::Simplification simplification = CayenneLPPPolyline::DouglasPeucker);
+  // Bounds ProgressiveDouglasPeucker, see CayenneLPPPolyline::setSimplificationBudget
+  void setPolylineBudget(uint32_t operations, uint32_t micros = 0);
+  // Filters GPS jitter before encoding, see CayenneLPPPolyline::Filter
+  void setPolylineFilter(const CayenneLPPPolyline::Filter& filter);
 #endif
 
 protected:
@@ -233,11 +264,17 @@ protected:
   uint32_t getTypeMultiplier(uint8_t type);
   bool getTypeSigned(uint8_t type);
 
-  float getValue(uint8_t *buffer, uint8_t size, uint32_t multiplier,
+  float getValue(const uint8_t *buffer, uint8_t size, uint32_t multiplier,
                  bool is_signed);
-  uint32_t getValue32(uint8_t *buffer, uint8_t size);
+  uint32_t getValue32(const uint8_t *buffer, uint8_t size);
   template <typename T>
   uint8_t addField(uint8_t type, uint8_t channel, T value);
+#ifndef ARDUINO
+  template <typename Track>
+  uint8_t addPolylineExtField(uint8_t channel, const Track& track,
+                              CayenneLPPPolyline::Precision precision,
+                              CayenneLPPPolyline::Simplification simplification);
+#endif
 
   uint8_t *_buffer;
   uint8_t _maxsize;
@@ -0,0 +1,319 @@
+/*
+ * CayenneLPP - CayenneLPP Capture File
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+// Host only (requires POSIX mmap)
+#if !defined(ARDUINO) && !defined(IDF_VER)
+#include "CayenneLPPCapture.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint8_t s_fileMagic[4] = { 'L', 'P', 'P', 'C' };
+static const uint8_t s_indexMagic[4] = { 'L', 'P', 'P', 'I' };
+static const uint16_t s_version = 1;
+
+static const size_t s_fileHeaderSize = 8;
+static const size_t s_blockHeaderSize = 8;
+static const size_t s_indexEntrySize = 32;
+static const size_t s_trailerSize = 16;
+static const size_t s_recordColumnSize = 8 + 8 + 2;
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v; p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = v >> (8 * i);
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = v >> (8 * i);
+}
+
+static uint16_t get16(const uint8_t* p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static uint64_t get64(const uint8_t* p) {
+    return uint64_t(get32(p)) | uint64_t(get32(p + 4)) << 32;
+}
+
+// ----------------------------------------------------------------------------
+
+CayenneLPPCaptureWriter::CayenneLPPCaptureWriter(uint32_t blockRecords)
+    : m_blockRecords(blockRecords ? blockRecords : 1) {
+}
+
+CayenneLPPCaptureWriter::~CayenneLPPCaptureWriter() {
+    close();
+}
+
+bool CayenneLPPCaptureWriter::open(const char* path) {
+    close();
+
+    m_file = fopen(path, "wb");
+    if (!m_file) {
+        return false;
+    }
+
+    uint8_t header[s_fileHeaderSize] = {};
+    std::copy(s_fileMagic, s_fileMagic + 4, header);
+    put16(header + 4, s_version);
+    m_ok = fwrite(header, 1, sizeof(header), m_file) == sizeof(header);
+    m_offset = sizeof(header);
+
+    return m_ok;
+}
+
+bool CayenneLPPCaptureWriter::append(uint64_t deviceId, uint64_t timestamp, const uint8_t* payload, uint16_t size) {
+    if (!m_file || !m_ok || size > 0xFF) {
+        return false;
+    }
+
+    m_deviceIds.push_back(deviceId);
+    m_timestamps.push_back(timestamp);
+    m_lengths.push_back(size);
+    m_payloads.insert(m_payloads.end(), payload, payload + size);
+
+    if (m_deviceIds.size() >= m_blockRecords) {
+        return flush();
+    }
+
+    return true;
+}
+
+bool CayenneLPPCaptureWriter::close() {
+    if (!m_file) {
+        return false;
+    }
+
+    bool ok = flush();
+
+    // Write block index
+    const uint64_t indexOffset = m_offset;
+    std::vector<uint8_t> index(m_index.size() * s_indexEntrySize + s_trailerSize);
+    uint8_t* p = index.data();
+    for (const auto& block : m_index) {
+        put64(p, block.offset);
+        put32(p + 8, block.records);
+        put32(p + 12, 0);
+        put64(p + 16, block.firstTimestamp);
+        put64(p + 24, block.lastTimestamp);
+        p += s_indexEntrySize;
+    }
+
+    // Write trailer
+    put64(p, indexOffset);
+    put32(p + 8, m_index.size());
+    std::copy(s_indexMagic, s_indexMagic + 4, p + 12);
+
+    ok = ok && fwrite(index.data(), 1, index.size(), m_file) == index.size();
+    ok = (fclose(m_file) == 0) && ok;
+
+    m_file = nullptr;
+    m_ok = false;
+    m_index.clear();
+
+    return ok;
+}
+
+bool CayenneLPPCaptureWriter::flush() {
+    const uint32_t records = m_deviceIds.size();
+    if (!m_ok || records == 0) {
+        return m_ok;
+    }
+
+    std::vector<uint8_t> block(s_blockHeaderSize + records * s_recordColumnSize);
+    put32(block.data(), records);
+    put32(block.data() + 4, m_payloads.size());
+
+    // Store columns back to back
+    uint8_t* deviceIds = block.data() + s_blockHeaderSize;
+    uint8_t* timestamps = deviceIds + records * 8;
+    uint8_t* lengths = timestamps + records * 8;
+    for (uint32_t i = 0; i < records; ++i) {
+        put64(deviceIds + i * 8, m_deviceIds[i]);
+        put64(timestamps + i * 8, m_timestamps[i]);
+        put16(lengths + i * 2, m_lengths[i]);
+    }
+
+    m_ok = fwrite(block.data(), 1, block.size(), m_file) == block.size()
+        && fwrite(m_payloads.data(), 1, m_payloads.size(), m_file) == m_payloads.size();
+
+    m_index.push_back({ m_offset, records, m_timestamps.front(), m_timestamps.back() });
+    m_offset += block.size() + m_payloads.size();
+
+    m_deviceIds.clear();
+    m_timestamps.clear();
+    m_lengths.clear();
+    m_payloads.clear();
+
+    return m_ok;
+}
+
+// ----------------------------------------------------------------------------
+
+CayenneLPPCaptureReader::CayenneLPPCaptureReader() {
+}
+
+CayenneLPPCaptureReader::~CayenneLPPCaptureReader() {
+    close();
+}
+
+bool CayenneLPPCaptureReader::open(const char* path) {
+    close();
+
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < s_fileHeaderSize + s_trailerSize) {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = st.st_size;
+#ifdef MADV_SEQUENTIAL
+    madvise(data, m_size, MADV_SEQUENTIAL);
+#endif
+
+    // Validate header, trailer and index bounds
+    const uint8_t* trailer = m_data + m_size - s_trailerSize;
+    m_indexOffset = get64(trailer);
+    m_blockCount = get32(trailer + 8);
+    if (!std::equal(s_fileMagic, s_fileMagic + 4, m_data)
+            || get16(m_data + 4) != s_version
+            || !std::equal(s_indexMagic, s_indexMagic + 4, trailer + 12)
+            || m_indexOffset < s_fileHeaderSize
+            || m_indexOffset > m_size - s_trailerSize
+            || (m_size - s_trailerSize - m_indexOffset) / s_indexEntrySize < m_blockCount) {
+        close();
+        return false;
+    }
+
+    if (!seek(0) && m_blockCount != 0) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void CayenneLPPCaptureReader::close() {
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_indexOffset = 0;
+    m_blockCount = 0;
+    m_block = 0;
+    m_record = 0;
+    m_records = 0;
+}
+
+uint32_t CayenneLPPCaptureReader::getBlockCount() const {
+    return m_blockCount;
+}
+
+CayenneLPPCaptureReader::Block CayenneLPPCaptureReader::getBlock(uint32_t block) const {
+    Block info;
+    if (block >= m_blockCount) {
+        return info;
+    }
+
+    const uint8_t* p = m_data + m_indexOffset + block * s_indexEntrySize;
+    info.offset = get64(p);
+    info.records = get32(p + 8);
+    info.firstTimestamp = get64(p + 16);
+    info.lastTimestamp = get64(p + 24);
+
+    return info;
+}
+
+bool CayenneLPPCaptureReader::seek(uint32_t block) {
+    m_block = block;
+    m_record = 0;
+    m_records = 0;
+
+    return loadBlock(block);
+}
+
+bool CayenneLPPCaptureReader::next(Record& record) {
+    while (m_record >= m_records) {
+        if (m_block + 1 >= m_blockCount || !loadBlock(++m_block)) {
+            return false;
+        }
+    }
+
+    const uint16_t size = get16(m_lengths + m_record * 2);
+    if (size > static_cast<size_t>(m_payloadEnd - m_payload)) {
+        m_records = 0;
+        return false;
+    }
+
+    record.deviceId = get64(m_deviceIds + m_record * 8);
+    record.timestamp = get64(m_timestamps + m_record * 8);
+    record.payload = m_payload;
+    record.size = size;
+
+    m_payload += size;
+    ++m_record;
+
+    return true;
+}
+
+bool CayenneLPPCaptureReader::loadBlock(uint32_t block) {
+    m_record = 0;
+    m_records = 0;
+
+    if (block >= m_blockCount) {
+        return false;
+    }
+
+    const Block info = getBlock(block);
+    // Offsets come from the file, compare without sums that may wrap
+    if (info.offset < s_fileHeaderSize || info.offset > m_indexOffset - s_blockHeaderSize) {
+        return false;
+    }
+
+    const uint8_t* p = m_data + info.offset;
+    const uint64_t records = get32(p);
+    const uint64_t payloadBytes = get32(p + 4);
+    if (records != info.records
+            || records * s_recordColumnSize + payloadBytes > m_indexOffset - s_blockHeaderSize - info.offset) {
+        return false;
+    }
+
+    m_deviceIds = p + s_blockHeaderSize;
+    m_timestamps = m_deviceIds + records * 8;
+    m_lengths = m_timestamps + records * 8;
+    m_payload = m_lengths + records * 2;
+    m_payloadEnd = m_payload + payloadBytes;
+    m_records = records;
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * CayenneLPP - CayenneLPP Capture File
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef CAYENNELPPCAPTURE_H
+#define CAYENNELPPCAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/*
+ * Capture files archive raw LPP uplinks for host side replay. All integers
+ * are little endian. Records are grouped into blocks, each block stores its
+ * columns back to back, followed by a block index and a fixed size trailer:
+ *
+ *   File header   "LPPC" | u16 version | u16 reserved
+ *   Block         u32 record count | u32 payload bytes
+ *                 u64 device id[n] | u64 timestamp[n] | u16 length[n]
+ *                 payload bytes (length prefixed by the length column)
+ *   Block index   { u64 offset | u32 record count | u32 reserved |
+ *                   u64 first timestamp | u64 last timestamp }[blocks]
+ *   Trailer       u64 index offset | u32 block count | "LPPI"
+ */
+
+class CayenneLPPCaptureWriter {
+public:
+    /**
+     * @brief CayenneLPPCaptureWriter Creates a writer for capture files.
+     * @param blockRecords Number of records buffered per block.
+     */
+    CayenneLPPCaptureWriter(uint32_t blockRecords = 4096);
+    ~CayenneLPPCaptureWriter();
+
+    /**
+     * @brief open Creates (or truncates) a capture file and writes its header.
+     * @param path The file to write.
+     * @return true on success.
+     */
+    bool open(const char* path);
+
+    /**
+     * @brief append Appends one raw uplink to the capture file.
+     * @param deviceId The device identifier, e.g. the DevEUI.
+     * @param timestamp The reception time, e.g. milliseconds since epoch.
+     * @param payload The raw LPP payload.
+     * @param size The payload size in bytes, at most 255 like any LPP payload.
+     * @return true on success, false on error or if the payload is too large.
+     */
+    bool append(uint64_t deviceId, uint64_t timestamp, const uint8_t* payload, uint16_t size);
+
+    /**
+     * @brief close Flushes pending records, writes the block index and closes the file.
+     * @return true on success.
+     */
+    bool close();
+
+private:
+    struct BlockInfo {
+        uint64_t offset;
+        uint32_t records;
+        uint64_t firstTimestamp;
+        uint64_t lastTimestamp;
+    };
+
+    bool flush();
+
+    const uint32_t m_blockRecords = 0;
+    FILE* m_file = nullptr;
+    uint64_t m_offset = 0;
+    bool m_ok = false;
+
+    std::vector<uint64_t> m_deviceIds;
+    std::vector<uint64_t> m_timestamps;
+    std::vector<uint16_t> m_lengths;
+    std::vector<uint8_t> m_payloads;
+    std::vector<BlockInfo> m_index;
+};
+
+class CayenneLPPCaptureReader {
+public:
+    struct Record {
+        uint64_t deviceId = 0;
+        uint64_t timestamp = 0;
+        const uint8_t* payload = nullptr;   ///< Points into the mapped file
+        uint16_t size = 0;
+    };
+
+    struct Block {
+        uint64_t offset = 0;
+        uint32_t records = 0;
+        uint64_t firstTimestamp = 0;
+        uint64_t lastTimestamp = 0;
+    };
+
+    CayenneLPPCaptureReader();
+    ~CayenneLPPCaptureReader();
+
+    CayenneLPPCaptureReader(const CayenneLPPCaptureReader&) = delete;
+    CayenneLPPCaptureReader& operator=(const CayenneLPPCaptureReader&) = delete;
+
+    /**
+     * @brief open Maps a capture file into memory and validates its index.
+     * @param path The file to read.
+     * @return true on success.
+     */
+    bool open(const char* path);
+
+    /**
+     * @brief close Unmaps the file. Payload pointers of records become invalid.
+     */
+    void close();
+
+    uint32_t getBlockCount() const;
+    Block getBlock(uint32_t block) const;
+
+    /**
+     * @brief seek Positions the reader at the first record of a block.
+     * @param block The block to start reading from.
+     * @return false if the block does not exist.
+     */
+    bool seek(uint32_t block);
+
+    /**
+     * @brief next Reads the next record without copying its payload.
+     * @param record The record to fill. Its payload points into the mapped file.
+     * @return false at the end of the file or if the file is corrupt.
+     */
+    bool next(Record& record);
+
+private:
+    bool loadBlock(uint32_t block);
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    uint64_t m_indexOffset = 0;
+    uint32_t m_blockCount = 0;
+
+    // Cursor
+    uint32_t m_block = 0;
+    uint32_t m_record = 0;
+    uint32_t m_records = 0;
+    const uint8_t* m_deviceIds = nullptr;
+    const uint8_t* m_timestamps = nullptr;
+    const uint8_t* m_lengths = nullptr;
+    const uint8_t* m_payload = nullptr;
+    const uint8_t* m_payloadEnd = nullptr;
+};
+
+#endif // CAYENNELPPCAPTURE_H
@@ -0,0 +1,122 @@
+/*
+ * CayenneLPP - CayenneLPP Deduplication Cache
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+// Host only
+#if !defined(ARDUINO) && !defined(IDF_VER)
+#include "CayenneLPPDedup.h"
+#include "CayenneLPP.h"
+
+#include <algorithm>
+
+#define DEDUP_SHARDS 16
+#define DEDUP_PROBES 8
+
+static uint64_t fnv1a(const uint8_t* data, uint8_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint8_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+CayenneLPPDedup::CayenneLPPDedup(uint32_t capacity, uint32_t ttlMs)
+    : m_ttlMs(ttlMs),
+      m_shards(DEDUP_SHARDS) {
+    const uint32_t perShard = std::max<uint32_t>((capacity + DEDUP_SHARDS - 1) / DEDUP_SHARDS, DEDUP_PROBES);
+    for (auto& shard : m_shards) {
+        shard.entries.resize(perShard);
+    }
+}
+
+std::shared_ptr<const CayenneLPPDedup::Result> CayenneLPPDedup::decode(uint64_t deviceId, uint32_t fCnt,
+                                                                       const uint8_t* payload, uint8_t size,
+                                                                       uint64_t nowMs, bool* duplicate) {
+    const uint64_t hash = fnv1a(payload, size);
+    const uint64_t key = mix(hash ^ mix(deviceId) ^ fCnt);
+    Shard& shard = m_shards[key % DEDUP_SHARDS];
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (Entry* entry = find(shard, key, deviceId, fCnt, hash, nowMs)) {
+            ++m_hits;
+            if (duplicate) *duplicate = true;
+            return entry->result;
+        }
+    }
+
+    // Decode outside of the lock, one decoder per thread
+    thread_local CayenneLPP lpp(0);
+    auto result = std::make_shared<Result>();
+    result->count = lpp.decode(payload, size, result->messages);
+    result->error = lpp.getError();
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // Another gateway's copy may have been decoded concurrently, this one is the duplicate
+    if (Entry* entry = find(shard, key, deviceId, fCnt, hash, nowMs)) {
+        ++m_hits;
+        if (duplicate) *duplicate = true;
+        return entry->result;
+    }
+    ++m_misses;
+    if (duplicate) *duplicate = false;
+
+    Entry& entry = slot(shard, key, nowMs);
+    entry.deviceId = deviceId;
+    entry.hash = hash;
+    entry.fCnt = fCnt;
+    entry.expiry = nowMs + m_ttlMs;
+    entry.result = result;
+
+    return result;
+}
+
+uint64_t CayenneLPPDedup::getHits() const {
+    return m_hits;
+}
+
+uint64_t CayenneLPPDedup::getMisses() const {
+    return m_misses;
+}
+
+CayenneLPPDedup::Entry* CayenneLPPDedup::find(Shard& shard, uint64_t key, uint64_t deviceId, uint32_t fCnt,
+                                              uint64_t hash, uint64_t nowMs) {
+    const size_t size = shard.entries.size();
+    const size_t start = (key / DEDUP_SHARDS) % size;
+    for (size_t i = 0; i < DEDUP_PROBES; ++i) {
+        Entry& entry = shard.entries[(start + i) % size];
+        if (entry.result && entry.expiry > nowMs
+                && entry.hash == hash && entry.deviceId == deviceId && entry.fCnt == fCnt) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+CayenneLPPDedup::Entry& CayenneLPPDedup::slot(Shard& shard, uint64_t key, uint64_t nowMs) {
+    // Take the first free or expired slot of the probe window, else evict the oldest
+    const size_t size = shard.entries.size();
+    const size_t start = (key / DEDUP_SHARDS) % size;
+    Entry* oldest = &shard.entries[start];
+    for (size_t i = 0; i < DEDUP_PROBES; ++i) {
+        Entry& entry = shard.entries[(start + i) % size];
+        if (!entry.result || entry.expiry <= nowMs) {
+            return entry;
+        }
+        if (entry.expiry < oldest->expiry) {
+            oldest = &entry;
+        }
+    }
+    return *oldest;
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * CayenneLPP - CayenneLPP Deduplication Cache
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef CAYENNELPPDEDUP_H
+#define CAYENNELPPDEDUP_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CayenneLPPMessage.h"
+
+/**
+ * @brief Decodes uplinks once, no matter through how many gateways they arrive.
+ *  Frames are keyed on device id, frame counter and payload hash. Entries live in
+ *  a fixed size table split into independently locked shards and expire after a
+ *  configurable time. Duplicates return the cached decode result.
+ */
+class CayenneLPPDedup {
+public:
+    struct Result {
+        uint8_t count = 0;      ///< Number of decoded fields, 0 on error
+        uint8_t error = 0;      ///< LPP_ERROR_* of the decoder
+        std::map<uint8_t, CayenneLPPMessage> messages;
+    };
+
+    /**
+     * @brief CayenneLPPDedup Creates a deduplication cache.
+     * @param capacity The maximum number of cached frames.
+     * @param ttlMs The time after which a cached frame expires.
+     */
+    CayenneLPPDedup(uint32_t capacity = 4096, uint32_t ttlMs = 10000);
+
+    /**
+     * @brief decode Decodes a frame or returns the cached result of an identical frame.
+     * @param deviceId The device identifier, e.g. DevAddr or DevEUI.
+     * @param fCnt The frame counter.
+     * @param payload The LPP payload.
+     * @param size The payload size.
+     * @param nowMs The current time in milliseconds, used for expiry.
+     * @param duplicate Set to true if the result was taken from the cache.
+     * @return result The shared decode result.
+     */
+    std::shared_ptr<const Result> decode(uint64_t deviceId, uint32_t fCnt,
+                                         const uint8_t* payload, uint8_t size,
+                                         uint64_t nowMs, bool* duplicate = nullptr);
+
+    uint64_t getHits() const;
+    uint64_t getMisses() const;
+
+private:
+    struct Entry {
+        uint64_t deviceId = 0;
+        uint64_t hash = 0;
+        uint32_t fCnt = 0;
+        uint64_t expiry = 0;
+        std::shared_ptr<const Result> result;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+    };
+
+    Entry* find(Shard& shard, uint64_t key, uint64_t deviceId, uint32_t fCnt, uint64_t hash, uint64_t nowMs);
+    Entry& slot(Shard& shard, uint64_t key, uint64_t nowMs);
+
+    const uint32_t m_ttlMs = 0;
+    std::vector<Shard> m_shards;
+    std::atomic<uint64_t> m_hits { 0 };
+    std::atomic<uint64_t> m_misses { 0 };
+};
+
+#endif // CAYENNELPPDEDUP_H
@@ -48,6 +48,9 @@ struct CayenneLPPMessage {
 
   // Non-IPSO data types
   std::vector<std::pair<double, double>> polyline;
+  std::vector<uint32_t> polylineTime;   // unix times of the polyline, if sent
+  std::vector<double> polylineAltitude; // altitudes of the polyline in metres, if sent
+  std::vector<uint32_t> polylineSegments; // indices of the polyline where a new segment starts
 };
 
 #endif
@@ -0,0 +1,222 @@
+/*
+ * CayenneLPP - CayenneLPP Batch Pipeline
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+// Host only
+#if !defined(ARDUINO) && !defined(IDF_VER)
+#include "CayenneLPPPipeline.h"
+#include "CayenneLPP.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Number of polls before a stage goes to sleep
+#define PIPELINE_SPINS 64
+
+// Lets the thread of one stage sleep until a neighbouring stage made progress.
+// Waiting polls briefly first, queues usually move within microseconds.
+class Waker {
+public:
+    template <typename Ready>
+    void wait(const Ready& ready) {
+        for (uint32_t i = 0; i < PIPELINE_SPINS; ++i) {
+            if (ready()) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_waiting.store(true, std::memory_order_relaxed);
+        // Pairs with the fence in notify(), either the waiter sees the progress or the notifier sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready()) {
+            m_condition.wait(lock);
+        }
+        m_waiting.store(false, std::memory_order_relaxed);
+    }
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiting.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_condition.notify_one();
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::atomic<bool> m_waiting { false };
+};
+
+CayenneLPPPipeline::CayenneLPPPipeline(uint32_t workers, uint32_t queueSize)
+    : m_workers(workers ? workers : std::max(std::thread::hardware_concurrency(), 3U) - 2),
+      m_queueSize(queueSize) {
+}
+
+uint64_t CayenneLPPPipeline::run(const Reader& reader, const Writer& writer) {
+    using InQueue = CayenneLPPSpscQueue<Frame>;
+    using OutQueue = CayenneLPPSpscQueue<Result>;
+
+    // Each worker has its own pair of queues. Frames are dealt round robin,
+    // so collecting them in the same order preserves the input order.
+    std::vector<std::unique_ptr<InQueue>> inQueues;
+    std::vector<std::unique_ptr<OutQueue>> outQueues;
+    for (uint32_t i = 0; i < m_workers; ++i) {
+        inQueues.emplace_back(new InQueue(m_queueSize));
+        outQueues.emplace_back(new OutQueue(m_queueSize));
+    }
+
+    // One waker per thread
+    Waker readWaker;
+    Waker writeWaker;
+    std::vector<Waker> workerWakers(m_workers);
+
+    std::atomic<bool> readerDone { false };
+    std::atomic<uint64_t> readCount { 0 };
+
+    // The first exception of any stage stops all of them and is rethrown by run()
+    std::atomic<bool> stop { false };
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto fail = [&](std::exception_ptr exception) {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) {
+                error = exception;
+            }
+        }
+        stop.store(true);
+        readWaker.notify();
+        writeWaker.notify();
+        for (auto& waker : workerWakers) {
+            waker.notify();
+        }
+    };
+
+    std::thread readThread([&]() {
+        uint64_t count = 0;
+        try {
+            Frame frame;
+            while (!stop.load(std::memory_order_relaxed) && reader(frame)) {
+                const uint32_t worker = count % m_workers;
+                InQueue& queue = *inQueues[worker];
+                Frame* slot = nullptr;
+                readWaker.wait([&]() { return (slot = queue.back()) || stop.load(std::memory_order_relaxed); });
+                if (!slot) {
+                    break;
+                }
+                *slot = frame;
+                queue.push();
+                workerWakers[worker].notify();
+                ++count;
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        readCount.store(count, std::memory_order_relaxed);
+        readerDone.store(true, std::memory_order_release);
+        writeWaker.notify();
+        for (auto& waker : workerWakers) {
+            waker.notify();
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < m_workers; ++i) {
+        workers.emplace_back([&, i]() {
+            // Decoding does not use the encode buffer
+            CayenneLPP lpp(0);
+            InQueue& in = *inQueues[i];
+            OutQueue& out = *outQueues[i];
+            Waker& waker = workerWakers[i];
+            try {
+                for (;;) {
+                    Frame* frame = nullptr;
+                    waker.wait([&]() {
+                        return (frame = in.front()) || readerDone.load(std::memory_order_acquire)
+                            || stop.load(std::memory_order_relaxed);
+                    });
+                    // All frames are pushed before the reader is done
+                    if (stop.load(std::memory_order_relaxed) || (!frame && !(frame = in.front()))) {
+                        return;
+                    }
+
+                    Result* result = nullptr;
+                    waker.wait([&]() { return (result = out.back()) || stop.load(std::memory_order_relaxed); });
+                    if (!result) {
+                        return;
+                    }
+
+                    result->frame = *frame;
+                    result->messages.clear();
+                    // Frames of a custom reader may exceed the 255 bytes of an LPP payload
+                    if (frame->size > 0xFF) {
+                        result->count = 0;
+                        result->error = LPP_ERROR_OVERFLOW;
+                    } else {
+                        result->count = lpp.decode(frame->payload, static_cast<uint8_t>(frame->size), result->messages);
+                        result->error = lpp.getError();
+                    }
+
+                    in.pop();
+                    readWaker.notify();
+                    out.push();
+                    writeWaker.notify();
+                }
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        });
+    }
+
+    // Write stage runs on the calling thread
+    uint64_t written = 0;
+    try {
+        for (;;) {
+            const uint32_t worker = written % m_workers;
+            OutQueue& queue = *outQueues[worker];
+            Result* result = nullptr;
+            writeWaker.wait([&]() {
+                return (result = queue.front()) || stop.load(std::memory_order_relaxed)
+                    || (readerDone.load(std::memory_order_acquire)
+                        && written == readCount.load(std::memory_order_relaxed));
+            });
+            if (!result || stop.load(std::memory_order_relaxed)) {
+                break;
+            }
+
+            writer(*result);
+            queue.pop();
+            workerWakers[worker].notify();
+            ++written;
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+
+    readThread.join();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    return written;
+}
+
+uint64_t CayenneLPPPipeline::run(CayenneLPPCaptureReader& capture, const Writer& writer) {
+    return run([&capture](Frame& frame) { return capture.next(frame); }, writer);
+}
+
+#endif
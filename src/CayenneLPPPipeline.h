@@ -0,0 +1,135 @@
+/*
+ * CayenneLPP - CayenneLPP Batch Pipeline
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef CAYENNELPPPIPELINE_H
+#define CAYENNELPPPIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "CayenneLPPCapture.h"
+#include "CayenneLPPMessage.h"
+
+/**
+ * @brief Bounded lock-free queue for exactly one producer and one consumer.
+ *  Slots are preallocated and filled in place, so objects keep their storage
+ *  while cycling through the queue.
+ */
+template <typename T>
+class CayenneLPPSpscQueue {
+public:
+    CayenneLPPSpscQueue(uint32_t size) {
+        uint32_t capacity = 2;
+        while (capacity < size) capacity <<= 1;
+        m_slots.resize(capacity);
+        m_mask = capacity - 1;
+    }
+
+    /**
+     * @brief back Returns the next free slot or nullptr if the queue is full.
+     */
+    T* back() {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+            return nullptr;
+        }
+        return &m_slots[tail & m_mask];
+    }
+
+    /**
+     * @brief push Publishes the slot obtained by back().
+     */
+    void push() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief front Returns the oldest published slot or nullptr if the queue is empty.
+     */
+    T* front() {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_slots[head & m_mask];
+    }
+
+    /**
+     * @brief pop Releases the slot obtained by front().
+     */
+    void pop() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> m_slots;
+    uint32_t m_mask = 0;
+    // Keep producer and consumer index on separate cache lines
+    char m_padding0[64];
+    std::atomic<uint32_t> m_head { 0 };
+    char m_padding1[64];
+    std::atomic<uint32_t> m_tail { 0 };
+};
+
+class CayenneLPPPipeline {
+public:
+    using Frame = CayenneLPPCaptureReader::Record;
+
+    struct Result {
+        Frame frame;
+        uint8_t count = 0;      ///< Number of decoded fields, 0 on error
+        uint8_t error = 0;      ///< LPP_ERROR_* of the decoder
+        std::map<uint8_t, CayenneLPPMessage> messages;
+    };
+
+    /**
+     * @brief Reads the next frame. Returns false at the end of input.
+     *  The frame payload must stay valid until the pipeline returns.
+     */
+    using Reader = std::function<bool(Frame&)>;
+
+    /**
+     * @brief Writes a decoded frame. Called in input order from the thread calling run().
+     */
+    using Writer = std::function<void(const Result&)>;
+
+    /**
+     * @brief CayenneLPPPipeline Creates a read -> decode -> write pipeline.
+     * @param workers Number of decoder threads. 0 uses all cores but the reader and writer.
+     * @param queueSize Number of frames buffered between two stages.
+     */
+    CayenneLPPPipeline(uint32_t workers = 0, uint32_t queueSize = 1024);
+
+    /**
+     * @brief run Reads, decodes and writes frames concurrently until the reader is exhausted.
+     *  Stages block on full queues, so a slow writer throttles reader and decoders.
+     *  Waiting stages sleep after a short spin. If the reader or the writer throws,
+     *  all stages are stopped and the exception is rethrown. Frames larger than
+     *  255 bytes are not decoded but written with LPP_ERROR_OVERFLOW.
+     * @param reader The reading stage.
+     * @param writer The writing stage.
+     * @return count The number of frames written.
+     */
+    uint64_t run(const Reader& reader, const Writer& writer);
+
+    /**
+     * @brief run Decodes all records of a capture file.
+     * @param capture An opened capture file.
+     * @param writer The writing stage.
+     * @return count The number of frames written.
+     */
+    uint64_t run(CayenneLPPCaptureReader& capture, const Writer& writer);
+
+private:
+    const uint32_t m_workers = 0;
+    const uint32_t m_queueSize = 0;
+};
+
+#endif // CAYENNELPPPIPELINE_H
@@ -10,31 +10,41 @@
 #ifndef ARDUINO
 #include "CayenneLPPPolyline.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <map>
-
-const double scaleFactor = 10000.0;
-const std::map<uint8_t, double> s_valueMap {
-    //{ 224, 0.0 },       // 0.00001, reserved
-    //{ 225, 0.0 },       // 0.000025, reserved
-    //{ 226, 0.0 },       // 0.00005, reserved
-    { 227, 1.0 },       // 0.0001
-    { 228, 2.0 },       // 0.0002
-    { 229, 5.0 },       // 0.0005
-    { 230, 10.0 },      // 0.001
-    { 231, 20.0 },      // 0.002
-    { 232, 50.0 },      // 0.005
-    { 233, 100.0 },     // 0.01
-    { 234, 200.0 },     // 0.02
-    { 235, 500.0 },     // 0.05
-    { 236, 1000.0 },    // 0.1
-    { 237, 2000.0 },    // 0.2
-    { 238, 5000.0 },    // 0.5
-    { 239, 10000.0 },   // 1.0
-    //{ 240, 20000.0 },   // 2.0
-    //{ 241, 50000.0 },   // 5.0
-    //{ 255, 0.0 }      // reserved
-};
+#include <iterator>
+#include <functional>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CAYENNE_LPP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+constexpr double CayenneLPPPolyline::ScaleFactor;
+
+static constexpr uint8_t s_precisionCount = CayenneLPPPolyline::Prec1_0 - CayenneLPPPolyline::Prec0_0001 + 1;
+
+static constexpr double factorValue(uint8_t factor) {
+    return CayenneLPPPolylineEncoder::getFactor(factor);
+}
+
+static_assert(CayenneLPPPolyline::Prec0_0001 == static_cast<int>(CayenneLPPPolylineEncoder::Prec0_0001)
+              && CayenneLPPPolyline::Prec1_0 == static_cast<int>(CayenneLPPPolylineEncoder::Prec1_0),
+              "Heap-free encoder uses other precision codes");
+static_assert(CayenneLPPPolyline::None == static_cast<int>(CayenneLPPPolylineEncoder::None)
+              && CayenneLPPPolyline::PerpendicularDistance == static_cast<int>(CayenneLPPPolylineEncoder::PerpendicularDistance)
+              && CayenneLPPPolyline::DouglasPeucker == static_cast<int>(CayenneLPPPolylineEncoder::DouglasPeucker),
+              "Heap-free encoder uses other simplification codes");
+static_assert(factorValue(CayenneLPPPolyline::PrecAuto) == 0.0, "PrecAuto must not be a valid factor");
+static_assert(factorValue(199) == 199.0 && factorValue(200) == 0.0 && factorValue(226) == 0.0, "Reserved codes");
+static_assert(factorValue(CayenneLPPPolyline::Prec0_0001) == 1.0 && factorValue(CayenneLPPPolyline::Prec0_01) == 100.0,
+              "Precision codes off by one");
+static_assert(factorValue(CayenneLPPPolyline::Prec1_0) == 10000.0 && factorValue(240) == 0.0, "Reserved codes");
+// Decoder kernels multiply with 16 bit
+static_assert(factorValue(CayenneLPPPolyline::Prec1_0) <= 32767.0, "Factor exceeds 16 bit");
+
 
 struct InitialCoord {
     int32_t lat:24;
@@ -46,89 +56,861 @@ struct DeltaCoord {
     int8_t dLon:4;
 };
 
-CayenneLPPPolyline::CayenneLPPPolyline(uint32_t size) : m_maxSize(size) {
+// Altitudes are compared with coordinates in degrees of latitude
+static constexpr double MetresPerDegree = 111320.0;
+static constexpr double Radians = 3.14159265358979323846 / 180.0;
+
+// Returns the index of the coord in (first, last) farthest from the line between
+// first and last and its squared distance in dmax. Ties go to the lowest index,
+// index 0 if no coord has a distance above 0.
+typedef uint32_t (*DistanceKernel)(const double*, const double*, uint32_t, uint32_t, double&);
+
+static uint32_t maxDistanceScalar(const double* lat, const double* lon, uint32_t first, uint32_t last, double& dmax) {
+    const double dLat = lat[last] - lat[first];
+    const double dLon = lon[last] - lon[first];
+    const double magSquared = dLat * dLat + dLon * dLon;
+
+    uint32_t index = 0;
+    dmax = 0.0;
+    for (uint32_t i = first+1; i < last; i++) {
+        const double pvx = lat[i] - lat[first];
+        const double pvy = lon[i] - lon[first];
+        double d;
+        if (magSquared <= 0.0) {
+            // Degenerated line, distance to its start
+            d = pvx * pvx + pvy * pvy;
+        } else {
+            // Cross product is the parallelogram area, divided by the base yields the height
+            const double cross = dLat * pvy - dLon * pvx;
+            d = cross * cross / magSquared;
+        }
+        if (d > dmax) {
+            index = i;
+            dmax = d;
+        }
+    }
+    return index;
 }
 
-std::vector<uint8_t> CayenneLPPPolyline::encode(const std::vector<Point>& coords,
-                                                uint8_t factor,
-                                                Simplification simplification) {
-    reset();
+// Same as maxDistanceScalar with altitudes, all in degrees
+static uint32_t maxDistance3d(const double* lat, const double* lon, const double* alt,
+                              uint32_t first, uint32_t last, double& dmax) {
+    const double dLat = lat[last] - lat[first];
+    const double dLon = lon[last] - lon[first];
+    const double dAlt = alt[last] - alt[first];
+    const double magSquared = dLat * dLat + dLon * dLon + dAlt * dAlt;
 
-    if (coords.size() < 2) {
-        return {};
+    uint32_t index = 0;
+    dmax = 0.0;
+    for (uint32_t i = first+1; i < last; i++) {
+        const double pvx = lat[i] - lat[first];
+        const double pvy = lon[i] - lon[first];
+        const double pvz = alt[i] - alt[first];
+        double d;
+        if (magSquared <= 0.0) {
+            d = pvx * pvx + pvy * pvy + pvz * pvz;
+        } else {
+            // Squared length of the cross product is the squared parallelogram area
+            const double x = dLon * pvz - dAlt * pvy;
+            const double y = dAlt * pvx - dLat * pvz;
+            const double z = dLat * pvy - dLon * pvx;
+            d = (x * x + y * y + z * z) / magSquared;
+        }
+        if (d > dmax) {
+            index = i;
+            dmax = d;
+        }
     }
+    return index;
+}
 
-    const double dFactor = getFactor(factor);
+#ifdef CAYENNE_LPP_X86_SIMD
+static_assert(sizeof(CayenneLPPPolyline::FixedPoint) == 8, "Kernel stores interleaved lat/lon pairs");
 
-    // Apply Douglas–Peucker first
-    auto coords2 = simplification == DouglasPeucker ? douglasPeucker(coords, dFactor/scaleFactor * 0.5) : coords;
+// Unpacks 16 delta bytes per step and returns the number of unpacked deltas.
+// Deltas are summed up before scaling, factor * (d0 + ... + dn) equals the
+// serial sum of scaled deltas, so the result is bit-exact with the scalar code.
+// Relies on the GCC/Clang bitfield layout of DeltaCoord (dLat in the low nibble).
+// The additions wrap, unlike the scalar code they do not overflow. getCount
+// rejects spans whose header or deltas could leave the 32 bit range, so both
+// paths agree on every span that is decoded at all.
+__attribute__((target("sse2")))
+static uint32_t deltasSse2(const uint8_t* in, uint32_t count, int32_t factor,
+                           CayenneLPPPolyline::FixedPoint& prev, CayenneLPPPolyline::FixedPoint* out) {
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i sign = _mm_set1_epi8(0x08);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i scale = _mm_set1_epi32(factor);
 
-    // Push initial item to init encoder
-    pushFirst(coords2.front().first * scaleFactor / dFactor, coords2.front().second * scaleFactor / dFactor, factor);
-    for (auto it = coords2.begin()+1; it != coords2.end() && m_buffer.size() < m_maxSize; ++it) {
-        // Latitude -/+ 90
-        // Longitude -/+ 180
-        if (abs(it->first) > 90.0 || abs(it->second) > 180.0) {
-            break;
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+        // Sign extend nibbles: (x ^ 8) - 8
+        __m128i lat = _mm_sub_epi8(_mm_xor_si128(_mm_and_si128(bytes, mask), sign), sign);
+        __m128i lon = _mm_sub_epi8(_mm_xor_si128(_mm_and_si128(_mm_srli_epi16(bytes, 4), mask), sign), sign);
+
+        // Prefix sums, 16 deltas of [-8, 7] stay within int8
+        lat = _mm_add_epi8(lat, _mm_slli_si128(lat, 1));
+        lon = _mm_add_epi8(lon, _mm_slli_si128(lon, 1));
+        lat = _mm_add_epi8(lat, _mm_slli_si128(lat, 2));
+        lon = _mm_add_epi8(lon, _mm_slli_si128(lon, 2));
+        lat = _mm_add_epi8(lat, _mm_slli_si128(lat, 4));
+        lon = _mm_add_epi8(lon, _mm_slli_si128(lon, 4));
+        lat = _mm_add_epi8(lat, _mm_slli_si128(lat, 8));
+        lon = _mm_add_epi8(lon, _mm_slli_si128(lon, 8));
+
+        // Widen to int16
+        const __m128i lat16[2] = { _mm_srai_epi16(_mm_unpacklo_epi8(lat, lat), 8),
+                                   _mm_srai_epi16(_mm_unpackhi_epi8(lat, lat), 8) };
+        const __m128i lon16[2] = { _mm_srai_epi16(_mm_unpacklo_epi8(lon, lon), 8),
+                                   _mm_srai_epi16(_mm_unpackhi_epi8(lon, lon), 8) };
+
+        // Scale as (sum, 0) * (factor, 0) pairs, add base and interleave to lat/lon
+        const __m128i baseLat = _mm_set1_epi32(prev.lat);
+        const __m128i baseLon = _mm_set1_epi32(prev.lon);
+        __m128i* dst = reinterpret_cast<__m128i*>(out + i);
+        for (int h = 0; h < 2; ++h) {
+            const __m128i latLo = _mm_add_epi32(baseLat, _mm_madd_epi16(_mm_unpacklo_epi16(lat16[h], zero), scale));
+            const __m128i latHi = _mm_add_epi32(baseLat, _mm_madd_epi16(_mm_unpackhi_epi16(lat16[h], zero), scale));
+            const __m128i lonLo = _mm_add_epi32(baseLon, _mm_madd_epi16(_mm_unpacklo_epi16(lon16[h], zero), scale));
+            const __m128i lonHi = _mm_add_epi32(baseLon, _mm_madd_epi16(_mm_unpackhi_epi16(lon16[h], zero), scale));
+            _mm_storeu_si128(dst++, _mm_unpacklo_epi32(latLo, lonLo));
+            _mm_storeu_si128(dst++, _mm_unpackhi_epi32(latLo, lonLo));
+            _mm_storeu_si128(dst++, _mm_unpacklo_epi32(latHi, lonHi));
+            _mm_storeu_si128(dst++, _mm_unpackhi_epi32(latHi, lonHi));
         }
+        prev = out[i + 15];
+    }
 
-        // Push each item to encoder
-        push(it->first * scaleFactor / dFactor, it->second * scaleFactor / dFactor, simplification == PerpendicularDistance);
+    return i;
+}
+
+// Same arithmetic as maxDistanceScalar, 4 coords per step. No FMA, so the
+// distances are bit-identical and so is the selected index.
+__attribute__((target("avx2")))
+static uint32_t maxDistanceAvx2(const double* lat, const double* lon, uint32_t first, uint32_t last, double& dmax) {
+    const double dLat = lat[last] - lat[first];
+    const double dLon = lon[last] - lon[first];
+    const double magSquared = dLat * dLat + dLon * dLon;
+    if (magSquared <= 0.0 || last - first < 9) {
+        return maxDistanceScalar(lat, lon, first, last, dmax);
     }
-    // Write final header
-    pushFirst(coords2.front().first * scaleFactor / dFactor, coords2.front().second * scaleFactor / dFactor, factor);
 
+    const __m256d vdLat = _mm256_set1_pd(dLat);
+    const __m256d vdLon = _mm256_set1_pd(dLon);
+    const __m256d vMag = _mm256_set1_pd(magSquared);
+    const __m256d vLat0 = _mm256_set1_pd(lat[first]);
+    const __m256d vLon0 = _mm256_set1_pd(lon[first]);
+    const __m256d step = _mm256_set1_pd(4.0);
+
+    // Per lane maximum and its index, strictly greater keeps the first one
+    __m256d vMax = _mm256_setzero_pd();
+    __m256d vIndex = _mm256_setzero_pd();
+    __m256d vCurrent = _mm256_setr_pd(first+1, first+2, first+3, first+4);
+
+    uint32_t i = first+1;
+    for (; i + 4 <= last; i += 4) {
+        const __m256d pvx = _mm256_sub_pd(_mm256_loadu_pd(lat + i), vLat0);
+        const __m256d pvy = _mm256_sub_pd(_mm256_loadu_pd(lon + i), vLon0);
+        const __m256d cross = _mm256_sub_pd(_mm256_mul_pd(vdLat, pvy), _mm256_mul_pd(vdLon, pvx));
+        const __m256d d = _mm256_div_pd(_mm256_mul_pd(cross, cross), vMag);
+        const __m256d greater = _mm256_cmp_pd(d, vMax, _CMP_GT_OQ);
+        vMax = _mm256_blendv_pd(vMax, d, greater);
+        vIndex = _mm256_blendv_pd(vIndex, vCurrent, greater);
+        vCurrent = _mm256_add_pd(vCurrent, step);
+    }
+
+    // Reduce lanes, equal distances resolve to the lowest index
+    double maxs[4];
+    double indices[4];
+    _mm256_storeu_pd(maxs, vMax);
+    _mm256_storeu_pd(indices, vIndex);
+    uint32_t index = 0;
+    dmax = 0.0;
+    for (int lane = 0; lane < 4; ++lane) {
+        const uint32_t laneIndex = indices[lane];
+        if (maxs[lane] > dmax || (maxs[lane] == dmax && maxs[lane] > 0.0 && laneIndex < index)) {
+            dmax = maxs[lane];
+            index = laneIndex;
+        }
+    }
+
+    // Tail, indices are above all previous ones
+    for (; i < last; i++) {
+        const double pvx = lat[i] - lat[first];
+        const double pvy = lon[i] - lon[first];
+        const double cross = dLat * pvy - dLon * pvx;
+        const double d = cross * cross / magSquared;
+        if (d > dmax) {
+            index = i;
+            dmax = d;
+        }
+    }
+    return index;
+}
+
+static DistanceKernel distanceKernel() {
+    static const DistanceKernel kernel = []() -> DistanceKernel {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return maxDistanceAvx2;
+        return maxDistanceScalar;
+    }();
+    return kernel;
+}
+
+typedef uint32_t (*DeltaKernel)(const uint8_t*, uint32_t, int32_t,
+                                CayenneLPPPolyline::FixedPoint&, CayenneLPPPolyline::FixedPoint*);
+
+static DeltaKernel deltaKernel() {
+    static const DeltaKernel kernel = []() -> DeltaKernel {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) return deltasSse2;
+        return nullptr;
+    }();
+    return kernel;
+}
+#else
+static DistanceKernel distanceKernel() {
+    return maxDistanceScalar;
+}
+#endif
+
+CayenneLPPPolyline::CayenneLPPPolyline(uint32_t size) : m_maxSize(size) {
+}
+
+std::vector<uint8_t> CayenneLPPPolyline::encode(const std::vector<Point>& coords,
+                                                uint8_t factor,
+                                                Simplification simplification,
+                                                uint32_t maxSize) {
+    m_out = nullptr;
+    encodeCoords(coords, factor, simplification, maxSize);
     return m_buffer;
 }
 
 std::vector<uint8_t> CayenneLPPPolyline::encode(const std::vector<Point>& coords,
                                                 Precision precision,
-                                                Simplification simplification) {
-    return encode(coords, static_cast<uint8_t>(precision), simplification);
+                                                Simplification simplification,
+                                                uint32_t maxSize) {
+    return encode(coords, static_cast<uint8_t>(precision), simplification, maxSize);
 }
 
-std::vector<std::pair<double, double>> CayenneLPPPolyline::decode(const std::vector<uint8_t>& buffer) {
-    if (buffer.size() < 7) {
-        return {};
+uint32_t CayenneLPPPolyline::encode(const std::vector<Point>& coords,
+                                    uint8_t factor,
+                                    Simplification simplification,
+                                    uint8_t* out,
+                                    uint32_t capacity,
+                                    uint32_t maxSize) {
+    m_out = out;
+    m_capacity = capacity;
+    encodeCoords(coords, factor, simplification, maxSize);
+    m_out = nullptr;
+    return m_size;
+}
+
+uint32_t CayenneLPPPolyline::encode(const std::vector<Point>& coords,
+                                    Precision precision,
+                                    Simplification simplification,
+                                    uint8_t* out,
+                                    uint32_t capacity,
+                                    uint32_t maxSize) {
+    return encode(coords, static_cast<uint8_t>(precision), simplification, out, capacity, maxSize);
+}
+
+std::vector<uint8_t> CayenneLPPPolyline::encodeExtended(const std::vector<Point>& coords,
+                                                        uint8_t factor,
+                                                        Simplification simplification,
+                                                        uint32_t maxSize) {
+    m_extended = true;
+    encode(coords, factor, simplification, maxSize);
+    m_extended = false;
+    return m_buffer;
+}
+
+std::vector<uint8_t> CayenneLPPPolyline::encodeExtended(const std::vector<Point>& coords,
+                                                        Precision precision,
+                                                        Simplification simplification,
+                                                        uint32_t maxSize) {
+    return encodeExtended(coords, static_cast<uint8_t>(precision), simplification, maxSize);
+}
+
+uint32_t CayenneLPPPolyline::encodeExtended(const std::vector<Point>& coords,
+                                            uint8_t factor,
+                                            Simplification simplification,
+                                            uint8_t* out,
+                                            uint32_t capacity,
+                                            uint32_t maxSize) {
+    m_extended = true;
+    const uint32_t size = encode(coords, factor, simplification, out, capacity, maxSize);
+    m_extended = false;
+    return size;
+}
+
+uint32_t CayenneLPPPolyline::encodeExtended(const std::vector<Point>& coords,
+                                            Precision precision,
+                                            Simplification simplification,
+                                            uint8_t* out,
+                                            uint32_t capacity,
+                                            uint32_t maxSize) {
+    return encodeExtended(coords, static_cast<uint8_t>(precision), simplification, out, capacity, maxSize);
+}
+
+std::vector<uint8_t> CayenneLPPPolyline::encodeExtended(const Trajectory& trajectory,
+                                                        uint8_t factor,
+                                                        Simplification simplification,
+                                                        uint32_t maxSize) {
+    m_out = nullptr;
+    if (setTrajectory(trajectory)) {
+        encodeExtended(trajectory.coords, factor, simplification, maxSize);
+    } else {
+        reset();
+    }
+    setTrajectory(Trajectory());
+    return m_buffer;
+}
+
+std::vector<uint8_t> CayenneLPPPolyline::encodeExtended(const Trajectory& trajectory,
+                                                        Precision precision,
+                                                        Simplification simplification,
+                                                        uint32_t maxSize) {
+    return encodeExtended(trajectory, static_cast<uint8_t>(precision), simplification, maxSize);
+}
+
+uint32_t CayenneLPPPolyline::encodeExtended(const Trajectory& trajectory,
+                                            uint8_t factor,
+                                            Simplification simplification,
+                                            uint8_t* out,
+                                            uint32_t capacity,
+                                            uint32_t maxSize) {
+    if (!setTrajectory(trajectory)) {
+        return 0;
+    }
+    const uint32_t size = encodeExtended(trajectory.coords, factor, simplification, out, capacity, maxSize);
+    setTrajectory(Trajectory());
+    return size;
+}
+
+uint32_t CayenneLPPPolyline::encodeExtended(const Trajectory& trajectory,
+                                            Precision precision,
+                                            Simplification simplification,
+                                            uint8_t* out,
+                                            uint32_t capacity,
+                                            uint32_t maxSize) {
+    return encodeExtended(trajectory, static_cast<uint8_t>(precision), simplification, out, capacity, maxSize);
+}
+
+std::vector<uint8_t> CayenneLPPPolyline::encodeExtended(const std::vector<std::vector<Point>>& segments,
+                                                        uint8_t factor,
+                                                        Simplification simplification,
+                                                        uint32_t maxSize) {
+    setSegments(segments);
+    encodeExtended(m_segmentCoords, factor, simplification, maxSize);
+    m_breaks.clear();
+    return m_buffer;
+}
+
+std::vector<uint8_t> CayenneLPPPolyline::encodeExtended(const std::vector<std::vector<Point>>& segments,
+                                                        Precision precision,
+                                                        Simplification simplification,
+                                                        uint32_t maxSize) {
+    return encodeExtended(segments, static_cast<uint8_t>(precision), simplification, maxSize);
+}
+
+uint32_t CayenneLPPPolyline::encodeExtended(const std::vector<std::vector<Point>>& segments,
+                                            uint8_t factor,
+                                            Simplification simplification,
+                                            uint8_t* out,
+                                            uint32_t capacity,
+                                            uint32_t maxSize) {
+    setSegments(segments);
+    const uint32_t size = encodeExtended(m_segmentCoords, factor, simplification, out, capacity, maxSize);
+    m_breaks.clear();
+    return size;
+}
+
+uint32_t CayenneLPPPolyline::encodeExtended(const std::vector<std::vector<Point>>& segments,
+                                            Precision precision,
+                                            Simplification simplification,
+                                            uint8_t* out,
+                                            uint32_t capacity,
+                                            uint32_t maxSize) {
+    return encodeExtended(segments, static_cast<uint8_t>(precision), simplification, out, capacity, maxSize);
+}
+
+void CayenneLPPPolyline::setSegments(const std::vector<std::vector<Point>>& segments) {
+    // Encoded as one track, the simplifications split it at the breaks again
+    m_segmentCoords.clear();
+    m_breaks.clear();
+    for (const auto& segment : segments) {
+        if (segment.empty()) {
+            continue;
+        }
+        if (!m_segmentCoords.empty()) {
+            m_breaks.push_back(m_segmentCoords.size());
+        }
+        m_segmentCoords.insert(m_segmentCoords.end(), segment.begin(), segment.end());
+    }
+}
+
+void CayenneLPPPolyline::segmentRanges(uint32_t size) {
+    // One range per segment, the first one on top
+    m_ranges.clear();
+    uint32_t last = size - 1;
+    for (auto it = m_breaks.rbegin(); it != m_breaks.rend(); ++it) {
+        m_ranges.emplace_back(*it, last);
+        last = *it - 1;
+    }
+    m_ranges.emplace_back(0, last);
+}
+
+bool CayenneLPPPolyline::setTrajectory(const Trajectory& trajectory) {
+    const std::vector<uint32_t>& times = trajectory.times;
+    const std::vector<double>& altitudes = trajectory.altitudes;
+    const size_t size = trajectory.coords.size();
+    const auto invalidAltitude = [](double altitude) {
+        return !(std::abs(altitude) * 100 < LPP_POLYLINE_ALTITUDE_LIMIT);
+    };
+    if ((!times.empty() && (times.size() != size || !std::is_sorted(times.begin(), times.end())))
+            || (!altitudes.empty() && (altitudes.size() != size
+            || std::any_of(altitudes.begin(), altitudes.end(), invalidAltitude)))) {
+        return false;
+    }
+
+    // Channels referenced while encoding, every coord gets one record of each
+    m_times = times.empty() ? nullptr : &times;
+    m_altitudes = altitudes.empty() ? nullptr : &altitudes;
+    m_flags = (m_times ? LPP_POLYLINE_FLAG_TIME : 0) | (m_altitudes ? LPP_POLYLINE_FLAG_ALTITUDE : 0);
+    return true;
+}
+
+void CayenneLPPPolyline::encodeCoords(const std::vector<Point>& coords,
+                                      uint8_t factor,
+                                      Simplification simplification,
+                                      uint32_t maxSize) {
+    if (coords.size() < 2 || (m_filter.stationaryRadius <= 0.0 && m_filter.maxSpeed <= 0.0)) {
+        encodeTrack(coords, factor, simplification, maxSize);
+        return;
+    }
+
+    // Encode the filtered copy, times and altitudes are filtered along
+    const std::vector<uint32_t>* times = m_times;
+    const std::vector<double>* altitudes = m_altitudes;
+    filter(coords);
+    m_times = times ? &m_filterTimes : nullptr;
+    m_altitudes = altitudes ? &m_filterAltitudes : nullptr;
+    encodeTrack(m_filterCoords, factor, simplification, maxSize);
+    m_times = times;
+    m_altitudes = altitudes;
+    m_stats.filteredCoords = coords.size() - m_filterCoords.size();
+}
+
+void CayenneLPPPolyline::filter(const std::vector<Point>& coords) {
+    m_filterCoords.clear();
+    m_filterTimes.clear();
+    m_filterAltitudes.clear();
+
+    const double lonScale = std::cos(coords.front().first * Radians);
+    const auto distance = [lonScale](const Point& a, const Point& b) {
+        return std::hypot(b.first - a.first, (b.second - a.second) * lonScale) * MetresPerDegree;
+    };
+    const auto tooFast = [&](uint32_t from, uint32_t to) {
+        const double elapsed = m_times ? (*m_times)[to] - (*m_times)[from] : to - from;
+        return distance(coords[from], coords[to]) > m_filter.maxSpeed * elapsed;
+    };
+
+    // Cluster of accepted fixes
+    Point sum;
+    double altitudeSum = 0.0;
+    uint32_t count = 0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    const auto emit = [&](const Point& coord, uint32_t index, double altitude) {
+        m_filterCoords.push_back(coord);
+        if (m_times) {
+            m_filterTimes.push_back((*m_times)[index]);
+        }
+        if (m_altitudes) {
+            m_filterAltitudes.push_back(altitude);
+        }
+    };
+    const auto flush = [&]() {
+        if (!count) {
+            return;
+        }
+        const Point centroid { sum.first / count, sum.second / count };
+        emit(centroid, first, altitudeSum / count);
+        if (m_times && (*m_times)[last] != (*m_times)[first]) {
+            emit(centroid, last, altitudeSum / count);
+        }
+        count = 0;
+    };
+
+    // Segments are filtered on their own, their breaks move along
+    const uint32_t size = coords.size();
+    for (size_t segment = 0; segment <= m_breaks.size(); ++segment) {
+        const uint32_t start = segment ? m_breaks[segment-1] : 0;
+        const uint32_t end = segment < m_breaks.size() ? m_breaks[segment] : size;
+        flush();
+        if (segment) {
+            m_breaks[segment-1] = m_filterCoords.size();
+        }
+
+        uint32_t accepted = start;
+        for (uint32_t i = start; i < end; ++i) {
+            // Drop a single outlier, but follow a track that really moved on
+            if (i > start && m_filter.maxSpeed > 0.0 && tooFast(accepted, i)
+                    && (i + 1 == end || !tooFast(accepted, i + 1))) {
+                continue;
+            }
+            accepted = i;
+
+            const double altitude = m_altitudes ? (*m_altitudes)[i] : 0.0;
+            if (count && distance({ sum.first / count, sum.second / count }, coords[i]) <= m_filter.stationaryRadius) {
+                sum.first += coords[i].first;
+                sum.second += coords[i].second;
+                altitudeSum += altitude;
+                ++count;
+                last = i;
+                continue;
+            }
+            flush();
+            sum = coords[i];
+            altitudeSum = altitude;
+            count = 1;
+            first = i;
+            last = i;
+        }
+    }
+    flush();
+
+    // A parked device still sends its position
+    if (m_filterCoords.size() == 1) {
+        emit(m_filterCoords.front(), size - 1, m_altitudes ? m_filterAltitudes.front() : 0.0);
+    }
+}
+
+void CayenneLPPPolyline::encodeTrack(const std::vector<Point>& coords,
+                                     uint8_t factor,
+                                     Simplification simplification,
+                                     uint32_t maxSize) {
+    reset();
+
+    if (coords.size() < 2) {
+        return;
+    }
+
+    uint32_t limit = m_maxSize;
+    bool ranked = false;
+    if (factor == PrecAuto) {
+        limit = maxSize ? maxSize : m_maxSize;
+        factor = selectFactor(coords, simplification, limit);
+        ranked = simplification == DouglasPeucker || simplification == DouglasPeuckerFit
+                || simplification == ProgressiveDouglasPeucker;
     }
 
-    const double dFactor = getFactor(buffer[1]);
-    if (dFactor == 0.0) {
+    // Apply simplification first. Only marks the coords to keep, nothing is copied.
+    const double dFactor = getFactor(factor);
+    const double epsilon = dFactor/ScaleFactor * 0.5;
+    if (simplification == DouglasPeucker) {
+        if (ranked) {
+            keepAbove(epsilon * epsilon);
+        } else {
+            douglasPeucker(coords, epsilon);
+        }
+    } else if (simplification == VisvalingamWhyatt) {
+        // A triangle with a base of one quantization step and a height of epsilon
+        visvalingamWhyatt(coords, epsilon * epsilon);
+    } else if (simplification == SynchronizedDouglasPeucker) {
+        synchronizedDouglasPeucker(coords, epsilon);
+    } else if (simplification == DouglasPeuckerFit) {
+        limit = maxSize ? maxSize : m_maxSize;
+        fit(coords, factor, limit, ranked);
+    } else if (simplification == ProgressiveDouglasPeucker) {
+        if (!ranked) {
+            progressiveRank(coords, epsilon * epsilon);
+        }
+        limit = maxSize ? maxSize : m_maxSize;
+        fit(coords, factor, limit, true, epsilon * epsilon);
+    }
+
+    write(coords, factor, simplification, limit);
+}
+
+bool CayenneLPPPolyline::begin(const Point& first, uint8_t factor, Simplification simplification) {
+    reset();
+
+    // Streams are written by the heap-free encoder, into a buffer of their own
+    m_streamBuffer.resize(std::min<uint32_t>(m_maxSize, std::numeric_limits<uint16_t>::max()));
+    return m_stream.begin(m_streamBuffer.data(), m_streamBuffer.size(), first.first, first.second,
+                          factor, simplification);
+}
+
+bool CayenneLPPPolyline::begin(const Point& first, Precision precision, Simplification simplification) {
+    return begin(first, static_cast<uint8_t>(precision), simplification);
+}
+
+bool CayenneLPPPolyline::push(const Point& coord) {
+    return m_stream.push(coord.first, coord.second);
+}
+
+std::vector<uint8_t> CayenneLPPPolyline::finish() {
+    const uint32_t size = m_stream.finish();
+    if (size > m_streamBuffer.size()) {
         return {};
     }
+    return std::vector<uint8_t>(m_streamBuffer.begin(), m_streamBuffer.begin() + size);
+}
 
+std::vector<std::pair<double, double>> CayenneLPPPolyline::decode(const std::vector<uint8_t>& buffer) {
     std::vector<std::pair<double, double>> coords;
-    //uint8_t size = buffer[0];
-    int32_t prevLat = buffer[2] << 24 | buffer[3] << 16 | buffer[4] << 8;
-    prevLat /= 256;
-    prevLat *= dFactor;
-    int32_t prevLon = buffer[5] << 24 | buffer[6] << 16 | buffer[7] << 8;
-    prevLon /= 256;
-    prevLon *= dFactor;
-    coords.push_back( { prevLat / scaleFactor, prevLon / scaleFactor } );
+    coords.reserve(getCount(buffer.data(), buffer.size()));
+    decode(buffer.data(), buffer.size(), std::back_inserter(coords));
+    return coords;
+}
+
+static int32_t readInt24(const uint8_t* buffer) {
+    // Sign extend 24 bit value
+    return static_cast<int32_t>(static_cast<uint32_t>(buffer[0]) << 24 | buffer[1] << 16 | buffer[2] << 8) / 256;
+}
+
+static bool readVarint(const uint8_t* buffer, uint32_t size, uint32_t& index, uint32_t& value) {
+    // 7 bits per byte, least significant first, at most 5 bytes
+    value = 0;
+    for (uint8_t shift = 0; shift < 35 && index < size; shift += 7) {
+        const uint8_t byte = buffer[index++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    if (buffer.size() == 7) {
-        return coords;
+bool CayenneLPPPolyline::decodeExtended(const uint8_t* buffer, uint32_t size, std::vector<Point>& coords,
+                                        std::vector<uint32_t>* times, std::vector<double>* altitudes,
+                                        std::vector<uint32_t>* segments, bool* truncated) {
+    const auto fail = [truncated](bool cut) {
+        if (truncated) {
+            *truncated = cut;
+        }
+        return false;
+    };
+    if (truncated) {
+        *truncated = false;
+    }
+    coords.clear();
+    if (times) {
+        times->clear();
+    }
+    if (altitudes) {
+        altitudes->clear();
+    }
+    if (segments) {
+        segments->clear();
+    }
+    if (size < 9) {
+        return fail(true);
     }
 
-    for (auto it = buffer.begin()+8; it != buffer.end(); ++it) {
-        const auto dc = *(DeltaCoord*)&*it;
-        const int dLat = dc.dLat * dFactor;
-        const int dLon = dc.dLon * dFactor;
-        coords.push_back( { (prevLat + dLat) / scaleFactor, (prevLon + dLon) / scaleFactor } );
-        prevLat += dLat;
-        prevLon += dLon;
+    const int32_t factor = getFactor(buffer[1]);
+    const uint8_t flags = buffer[2];
+    const bool timed = flags & LPP_POLYLINE_FLAG_TIME;
+    const bool elevated = flags & LPP_POLYLINE_FLAG_ALTITUDE;
+    const uint32_t header = 9 + (timed ? 4 : 0) + (elevated ? 3 : 0);
+    if (factor == 0 || (flags & ~(LPP_POLYLINE_FLAG_TIME | LPP_POLYLINE_FLAG_ALTITUDE))) {
+        return fail(false);
+    }
+    if (size < header) {
+        return fail(true);
     }
 
+    int64_t lat = static_cast<int64_t>(readInt24(&buffer[3])) * factor;
+    int64_t lon = static_cast<int64_t>(readInt24(&buffer[6])) * factor;
+    uint32_t time = timed ? static_cast<uint32_t>(buffer[9]) << 24 | buffer[10] << 16 | buffer[11] << 8 | buffer[12] : 0;
+    int64_t altitude = elevated ? readInt24(&buffer[header - 3]) : 0;
+    coords.reserve(size - header + 1);
+    coords.emplace_back(lat / ScaleFactor, lon / ScaleFactor);
+    if (timed && times) {
+        times->push_back(time);
+    }
+    if (elevated && altitudes) {
+        altitudes->push_back(altitude / 100.0);
+    }
+
+    for (uint32_t i = header; i < size; ) {
+        uint8_t byte = buffer[i++];
+        if (byte == LPP_POLYLINE_SEGMENT_BREAK) {
+            // A break is followed by the delta to the start of the next segment
+            if (i == size || buffer[i] == LPP_POLYLINE_SEGMENT_BREAK) {
+                return fail(i == size);
+            }
+            if (segments) {
+                segments->push_back(coords.size());
+            }
+            byte = buffer[i++];
+        }
+
+        int32_t dLat = 0;
+        int32_t dLon = 0;
+        if ((byte & 0x0F) != 0x08) {
+            // Sign extend nibbles
+            dLat = ((byte & 0x0F) ^ 0x08) - 0x08;
+            dLon = ((byte >> 4) ^ 0x08) - 0x08;
+        } else if (byte == LPP_POLYLINE_ESCAPE_8BIT && i + 2 <= size) {
+            dLat = static_cast<int8_t>(buffer[i]);
+            dLon = static_cast<int8_t>(buffer[i+1]);
+            i += 2;
+        } else if (byte == LPP_POLYLINE_ESCAPE_12BIT && i + 3 <= size) {
+            // Sign extend 12 bit values
+            dLat = static_cast<int32_t>(static_cast<uint32_t>(buffer[i]) << 24 | (buffer[i+1] & 0xF0) << 16) / (1 << 20);
+            dLon = static_cast<int32_t>(static_cast<uint32_t>(buffer[i+1] & 0x0F) << 28 | buffer[i+2] << 20) / (1 << 20);
+            i += 3;
+        } else if (byte == LPP_POLYLINE_ESCAPE_24BIT && i + 6 <= size) {
+            dLat = readInt24(&buffer[i]);
+            dLon = readInt24(&buffer[i+3]);
+            i += 6;
+        } else {
+            // Truncated or unknown escape
+            return fail(byte == LPP_POLYLINE_ESCAPE_8BIT || byte == LPP_POLYLINE_ESCAPE_12BIT
+                        || byte == LPP_POLYLINE_ESCAPE_24BIT);
+        }
+        lat += dLat * factor;
+        lon += dLon * factor;
+        coords.emplace_back(lat / ScaleFactor, lon / ScaleFactor);
+
+        if (timed) {
+            uint32_t dTime = 0;
+            if (!readVarint(buffer, size, i, dTime)) {
+                return fail(i == size);
+            }
+            time += dTime;
+            if (times) {
+                times->push_back(time);
+            }
+        }
+
+        if (elevated) {
+            uint32_t dAltitude = 0;
+            if (!readVarint(buffer, size, i, dAltitude)) {
+                return fail(i == size);
+            }
+            // Zigzag decode, 0.1 m steps
+            altitude += 10 * (static_cast<int64_t>(dAltitude >> 1) ^ -static_cast<int64_t>(dAltitude & 1));
+            if (altitudes) {
+                altitudes->push_back(altitude / 100.0);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool CayenneLPPPolyline::decodeExtended(const uint8_t* buffer, uint32_t size, Trajectory& trajectory) {
+    return decodeExtended(buffer, size, trajectory.coords, &trajectory.times, &trajectory.altitudes);
+}
+
+bool CayenneLPPPolyline::decodeExtended(const uint8_t* buffer, uint32_t size, std::vector<std::vector<Point>>& segments) {
+    std::vector<Point> coords;
+    std::vector<uint32_t> breaks;
+    segments.clear();
+    if (!decodeExtended(buffer, size, coords, nullptr, nullptr, &breaks)) {
+        return false;
+    }
+
+    breaks.push_back(coords.size());
+    uint32_t first = 0;
+    for (const uint32_t last : breaks) {
+        segments.emplace_back(coords.begin() + first, coords.begin() + last);
+        first = last;
+    }
+    return true;
+}
+
+std::vector<CayenneLPPPolyline::Point> CayenneLPPPolyline::decodeExtended(const std::vector<uint8_t>& buffer) {
+    std::vector<Point> coords;
+    if (!decodeExtended(buffer.data(), buffer.size(), coords)) {
+        coords.clear();
+    }
     return coords;
 }
 
+uint32_t CayenneLPPPolyline::getCount(const uint8_t* buffer, uint32_t size) {
+    if (size < 8 || getFactor(buffer[1]) == 0.0) {
+        return 0;
+    }
+
+    // Spans may be untrusted, the first coordinate must be valid and the deltas
+    // of at most 8 steps must keep the decoded coordinates within 32 bit
+    const int64_t factor = getFactor(buffer[1]);
+    const int64_t lat = readInt24(&buffer[2]) * factor;
+    const int64_t lon = readInt24(&buffer[5]) * factor;
+    if (std::abs(lat) > 90 * ScaleFactor || std::abs(lon) > 180 * ScaleFactor
+            || (size - 8) * 8 * factor > INT32_MAX - 180 * ScaleFactor) {
+        return 0;
+    }
+
+    // Header holds the first coordinate, every further byte one delta
+    return size - 7;
+}
+
+uint32_t CayenneLPPPolyline::decodeChunk(const uint8_t* buffer, uint32_t size, uint32_t index,
+                                         FixedPoint& prev, FixedPoint* chunk) {
+    const uint32_t count = getCount(buffer, size);
+    if (index >= count) {
+        return 0;
+    }
+
+    // Factors are integral, so coordinates are exact in units of 1/ScaleFactor degrees
+    const int32_t factor = getFactor(buffer[1]);
+    uint32_t n = 0;
+    if (index == 0) {
+        // Within the range checked by getCount
+        prev.lat = static_cast<int64_t>(readInt24(&buffer[2])) * factor;
+        prev.lon = static_cast<int64_t>(readInt24(&buffer[5])) * factor;
+        chunk[n++] = prev;
+        ++index;
+    }
+
+#ifdef CAYENNE_LPP_X86_SIMD
+    // Factors up to 10000 fit the 16 bit multiplier of the kernel, getCount keeps
+    // base plus scaled deltas within 32 bit
+    if (DeltaKernel kernel = deltaKernel()) {
+        const uint32_t unpacked = kernel(&buffer[7 + index], std::min<uint32_t>(count - index, LPP_POLYLINE_DECODE_CHUNK - n),
+                                         factor, prev, chunk + n);
+        n += unpacked;
+        index += unpacked;
+    }
+#endif
+
+    for (; n < LPP_POLYLINE_DECODE_CHUNK && index < count; ++n, ++index) {
+        const auto dc = *(DeltaCoord*)&buffer[7 + index];
+        prev.lat += dc.dLat * factor;
+        prev.lon += dc.dLon * factor;
+        chunk[n] = prev;
+    }
+
+    return n;
+}
+
+void CayenneLPPPolyline::setSimplificationBudget(uint32_t operations, uint32_t micros) {
+    m_budgetOperations = operations;
+    m_budgetMicros = micros;
+}
+
+void CayenneLPPPolyline::setFilter(const Filter& filter) {
+    m_filter = filter;
+}
+
 CayenneLPPPolyline::Stats CayenneLPPPolyline::getEncodeStats() const {
     return m_stats;
 }
 
 void CayenneLPPPolyline::reset() {
-    m_buffer.clear();
+    if (!m_out) {
+        m_buffer.clear();
+    }
+    m_size = 0;
+    m_lastNibble = false;
     m_prevLat = 0.0;
     m_prevLon = 0.0;
     m_errLat = 0.0;
@@ -136,58 +918,248 @@ void CayenneLPPPolyline::reset() {
     m_stats = {};
 }
 
-double CayenneLPPPolyline::getFactor(uint8_t factor) {
-    if ( factor == 0) {
-        return 0.0;
-    } else if (factor < 200) {
-        return factor;
-    } else if (s_valueMap.count(factor)) {
-        return s_valueMap.at(factor);
-    } else {
-        return 0.0;
+void CayenneLPPPolyline::write(const std::vector<Point>& coords, uint8_t factor,
+                               Simplification simplification, uint32_t limit) {
+    reset();
+
+    const double dFactor = getFactor(factor);
+    const bool simplify = simplification != None && simplification != PerpendicularDistance;
+    // Merging deltas would lose their times and altitudes
+    const bool optimize = simplification == PerpendicularDistance && !m_flags;
+    uint32_t time = m_times ? m_times->front() : 0;
+    int32_t altitude = m_altitudes ? round(m_altitudes->front() * 100) : 0;
+
+    // Errors in steps of the factor. A longitude step is shorter by the cosine of the latitude.
+    const double metresPerStep = dFactor / ScaleFactor * MetresPerDegree;
+    const double lonScale = std::cos(coords.front().first * Radians);
+    double sumSquares = 0.0;
+    double sumSquaresMetres = 0.0;
+    const auto addError = [&](const Point& error) {
+        const double steps = error.first * error.first + error.second * error.second;
+        const double metres = (error.first * error.first + error.second * error.second * lonScale * lonScale)
+                            * metresPerStep * metresPerStep;
+        m_stats.maxErrorSteps = std::max(m_stats.maxErrorSteps, sqrt(steps));
+        m_stats.maxError = std::max(m_stats.maxError, sqrt(metres));
+        sumSquares += steps;
+        sumSquaresMetres += metres;
+    };
+
+    const auto scaled = [&](size_t i) -> Point {
+        return { coords[i].first * ScaleFactor / dFactor, coords[i].second * ScaleFactor / dFactor };
+    };
+
+    // Push initial item to init encoder
+    pushFirst(scaled(0).first, scaled(0).second, factor);
+
+    // Coords from runFirst to lastKept are decoded on the last record, which spans
+    // from runStart to runEnd. It grows while coords are merged into it or dropped,
+    // so their errors are final once another record is written. Coords removed by
+    // simplification are measured against the line between their kept neighbours.
+    size_t runFirst = 0;
+    size_t lastKept = 0;
+    Point runEnd { scaled(0).first - m_errLat, scaled(0).second - m_errLon };
+    Point runStart = runEnd;
+    const auto commitRun = [&]() {
+        for (size_t j = runFirst; j <= lastKept; ++j) {
+            addError(offset(scaled(j), runStart, runEnd));
+        }
+    };
+
+    auto nextBreak = m_breaks.begin();
+    for (size_t i = 1; i < coords.size() && m_size < limit; ++i) {
+        m_break = nextBreak != m_breaks.end() && *nextBreak == i;
+        if (!m_break && simplify && !m_keep[i]) {
+            continue;
+        }
+
+        // Latitude -/+ 90
+        // Longitude -/+ 180
+        const Point& coord = coords[i];
+        if (std::abs(coord.first) > 90.0 || std::abs(coord.second) > 180.0) {
+            break;
+        }
+
+        if (m_break) {
+            ++nextBreak;
+            put(m_size++, LPP_POLYLINE_SEGMENT_BREAK);
+            m_lastNibble = false;
+        }
+
+        // Push each item to encoder
+        const Point target = scaled(i);
+        const uint32_t size = m_size;
+        m_merged = false;
+        push(target.first, target.second, optimize);
+
+        const Point decoded { target.first - m_errLat, target.second - m_errLon };
+        if (m_merged) {
+            runStart = { static_cast<double>(m_mergeStart.lat), static_cast<double>(m_mergeStart.lon) };
+            runEnd = { static_cast<double>(m_mergeEnd.lat), static_cast<double>(m_mergeEnd.lon) };
+        }
+        // No record was written, the coord was merged into the last one or dropped
+        if (m_size == size) {
+            lastKept = i;
+        } else {
+            commitRun();
+            for (size_t j = lastKept + 1; j < i; ++j) {
+                addError(offset(scaled(j), runEnd, decoded));
+            }
+            runFirst = i;
+            lastKept = i;
+            runStart = decoded;
+            runEnd = decoded;
+        }
+
+        if (m_times) {
+            writeVarint((*m_times)[i] - time);
+            time = (*m_times)[i];
+        }
+        if (m_altitudes) {
+            // Rounded against the decoded altitude, so errors do not add up
+            const int32_t delta = round(((*m_altitudes)[i] * 100 - altitude) / 10);
+            writeVarint(static_cast<uint32_t>(delta) << 1 ^ static_cast<uint32_t>(delta >> 31));
+            altitude += delta * 10;
+        }
     }
+    m_break = false;
+    commitRun();
+
+    const uint32_t count = lastKept + 1;
+    m_stats.rmsErrorSteps = sqrt(sumSquares / count);
+    m_stats.rmsError = sqrt(sumSquaresMetres / count);
+
+    // Write final header
+    pushFirst(coords.front().first * ScaleFactor / dFactor, coords.front().second * ScaleFactor / dFactor, factor);
+
+    const uint32_t rawSize = 6 + (m_times ? 4 : 0) + (m_altitudes ? 3 : 0);
+    m_stats.compressionRatio = static_cast<double>(count * rawSize) / m_size;
 }
 
-void CayenneLPPPolyline::push(double lat, double lon, bool optimize) {
-    // Compute delta and correct error from previous rounding
-    const double dLat = (lat - m_prevLat) + m_errLat;
-    const double dLon = (lon - m_prevLon) + m_errLon;
-
-    // Round values
-    const int32_t roundLat = round(dLat);
-    const int32_t roundLon = round(dLon);
-
-    // Ignore items with zero delta
-    if ((abs(roundLat) < 1) && (abs(roundLon) < 1)) {
-        ++m_stats.removedCoords;
-    // Delta fits into one nibble, push it
-    } else if (abs(roundLat) < 8 && abs(roundLon) < 8) {
-        writeDelta(roundLat, roundLon, optimize);
-    // Delta is too big for one nibble. Compute intermediates.
+uint8_t CayenneLPPPolyline::selectFactor(const std::vector<Point>& coords, Simplification simplification, uint32_t maxSize) {
+    // Douglas-Peucker results for every precision are thresholds of one ranking
+    const bool ranked = simplification == DouglasPeucker || simplification == DouglasPeuckerFit;
+    if (ranked) {
+        rank(coords);
+    } else if (simplification == ProgressiveDouglasPeucker) {
+        // Spend the budget once, down to the finest precision
+        const double epsilon = factorValue(Prec0_0001)/ScaleFactor * 0.5;
+        progressiveRank(coords, epsilon * epsilon);
+    }
+
+    // Encoded size shrinks with coarser precision. Search the finest one that fits
+    // and fall back to the coarsest one.
+    uint8_t best = s_precisionCount - 1;
+    int lo = 0;
+    int hi = s_precisionCount - 2;
+    while (lo <= hi) {
+        const int mid = lo + (hi - lo) / 2;
+        const uint8_t factor = Prec0_0001 + mid;
+        const double epsilon = factorValue(factor)/ScaleFactor * 0.5;
+        if (ranked || simplification == ProgressiveDouglasPeucker) {
+            keepAbove(epsilon * epsilon);
+        } else if (simplification == VisvalingamWhyatt) {
+            visvalingamWhyatt(coords, epsilon * epsilon);
+        } else if (simplification == SynchronizedDouglasPeucker) {
+            synchronizedDouglasPeucker(coords, epsilon);
+        }
+        write(coords, factor, simplification == DouglasPeuckerFit ? DouglasPeucker : simplification, UINT32_MAX);
+        if (m_size <= maxSize) {
+            best = mid;
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return Prec0_0001 + best;
+}
+
+void CayenneLPPPolyline::fit(const std::vector<Point>& coords, uint8_t factor, uint32_t maxSize, bool ranked,
+                             double minImportance) {
+    // Rank coords by importance once, then search the number of most important
+    // coords that still fits. Every candidate costs one linear encode.
+    if (!ranked) {
+        rank(coords);
+    }
+    const uint32_t size = coords.size();
+    const uint32_t available = std::count_if(m_importance.begin(), m_importance.end(), [minImportance](double importance) {
+        return importance > minImportance;
+    });
+    m_order.resize(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        m_order[i] = i;
+    }
+    std::stable_sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b) {
+        return m_importance[a] > m_importance[b];
+    });
+
+    const auto keep = [this, size](uint32_t count) {
+        m_keep.assign(size, 0);
+        for (uint32_t i = 0; i < count; ++i) {
+            m_keep[m_order[i]] = 1;
+        }
+    };
+    const auto fits = [&](uint32_t count) {
+        keep(count);
+        write(coords, factor, DouglasPeuckerFit, UINT32_MAX);
+        return m_size <= maxSize;
+    };
+
+    // Encoded size grows with the number of coords, apart from intermediates.
+    // If not even the end points of the segments fit, encode them and let the limit truncate.
+    const uint32_t ends = std::count(m_importance.begin(), m_importance.end(), std::numeric_limits<double>::infinity());
+    uint32_t best = ends;
+    if (fits(available)) {
+        best = available;
     } else {
-        ++m_stats.addedCoords;
-        --m_stats.keptCoords;
-        // Push intermediate. This is a simplified solution.
-        // A more sophisticated computation can be found her: https://www.movable-type.co.uk/scripts/latlong.html
-        // Please check the Intermediate point section.
-        const double divisor = ceil(std::max(abs(dLat/7.0), abs(dLon/7.0)));
-        push(m_prevLat + dLat / divisor, m_prevLon + dLon / divisor, optimize);
-        // Push original lat/lon after intermediate.
-        push(lat, lon, optimize);
-        return;
+        uint32_t lo = ends + 1;
+        uint32_t hi = available - 1;
+        while (lo <= hi) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            if (fits(mid)) {
+                best = mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
     }
+    keep(best);
+}
 
-    // Compute error from rounding
-    m_errLat = dLat - roundLat;
-    m_errLon = dLon - roundLon;
+double CayenneLPPPolyline::getFactor(uint8_t factor) {
+    return factorValue(factor);
+}
 
-    m_prevLat = lat;
-    m_prevLon = lon;
+void CayenneLPPPolyline::push(double lat, double lon, bool optimize) {
+    CayenneLPPPolylineEncoder::walk(lat, lon, m_prevLat, m_prevLon, m_errLat, m_errLon,
+                                    [this, optimize](int32_t roundLat, int32_t roundLon,
+                                                     double dLat, double dLon, bool target) {
+        // Ignore items with zero delta, unless their time or altitude is sent or they start a segment
+        if (!m_flags && !m_break && (std::abs(roundLat) < 1) && (std::abs(roundLon) < 1)) {
+            ++m_stats.removedCoords;
+        // Delta fits into one nibble, push it
+        } else if (std::abs(roundLat) < 8 && std::abs(roundLon) < 8) {
+            writeDelta(roundLat, roundLon, optimize);
+        // Delta is too big for one nibble. The extended format escapes it, unless
+        // the intermediates would take fewer bytes and carry no times or altitudes.
+        } else if (m_extended && target && (m_flags || m_break
+                   || ceil(std::max(std::abs(dLat/7.0), std::abs(dLon/7.0))) > escapeSize(roundLat, roundLon))) {
+            writeEscape(roundLat, roundLon);
+        // Otherwise compute intermediates.
+        } else {
+            ++m_stats.addedCoords;
+            --m_stats.keptCoords;
+            return false;
+        }
+        return true;
+    });
 }
 
 void CayenneLPPPolyline::pushFirst(double lat, double lon, uint8_t factor) {
     const int32_t roundLat = round(lat);
     const int32_t roundLon = round(lon);
+    m_decoded = { roundLat, roundLon };
 
     writeHeader(roundLat, roundLon, factor);
 
@@ -199,112 +1171,392 @@ void CayenneLPPPolyline::pushFirst(double lat, double lon, uint8_t factor) {
 }
 
 void CayenneLPPPolyline::writeHeader(int32_t lat, int32_t lon, uint8_t factor) {
-// ESP-IDF framework
-#if !defined(ARDUINO) && defined(IDF_VER)
-    m_buffer.resize(std::max(static_cast<long unsigned int>(m_buffer.size()), 8UL));
-#else
-    m_buffer.resize(std::max(m_buffer.size(), 8UL));
-#endif
-    m_buffer[0] = m_buffer.size();
-    m_buffer[1] = factor;
-    m_buffer[2] = (lat >> 16); m_buffer[3] = (lat >> 8); m_buffer[4] = (lat);
-    m_buffer[5] = (lon >> 16); m_buffer[6] = (lon >> 8); m_buffer[7] = (lon);
+    // The extended format has a flags byte after the factor
+    const uint8_t offset = m_extended ? 1 : 0;
+    m_size = std::max<uint32_t>(m_size, headerSize());
+    put(0, m_size);
+    put(1, factor);
+    if (m_extended) {
+        put(2, m_flags);
+    }
+    put(2 + offset, lat >> 16); put(3 + offset, lat >> 8); put(4 + offset, lat);
+    put(5 + offset, lon >> 16); put(6 + offset, lon >> 8); put(7 + offset, lon);
+    uint8_t index = 9;
+    if (m_times) {
+        const uint32_t time = m_times->front();
+        put(index++, time >> 24); put(index++, time >> 16); put(index++, time >> 8); put(index++, time);
+    }
+    if (m_altitudes) {
+        const int32_t altitude = round(m_altitudes->front() * 100);
+        put(index++, altitude >> 16); put(index++, altitude >> 8); put(index++, altitude);
+    }
+}
+
+uint8_t CayenneLPPPolyline::headerSize() const {
+    if (!m_extended) {
+        return 8;
+    }
+    return 9 + (m_times ? 4 : 0) + (m_altitudes ? 3 : 0);
 }
 
 void CayenneLPPPolyline::writeDelta(int8_t lat, int8_t lon, bool optimize) {
-    const DeltaCoord& prevDelta = (DeltaCoord&)m_buffer.back();
-    const DeltaCoord currDelta { lat, lon };
+    const DeltaCoord prevDelta = *(DeltaCoord*)&m_lastDelta;
+    DeltaCoord currDelta { lat, lon };
 
     // This is a cheap optimization as an alternative to Douglas-Peucker
     // Check if the sum of this and next delta is within range
     const int8_t dLat = prevDelta.dLat + currDelta.dLat;
     const int8_t dLon = prevDelta.dLon + currDelta.dLon;
-    if (optimize && m_buffer.size() > 8 && abs(dLat) < 8 && abs(dLon) < 8) {
+    if (optimize && m_lastNibble && std::abs(dLat) < 8 && std::abs(dLon) < 8) {
         // Check if previous delta only differs slightly from straight line to current delta
-        const double distance = abs(dLat * -1.0 * prevDelta.dLon + prevDelta.dLat * dLon) / sqrt(dLat * dLat + dLon * dLon);
+        const double distance = std::abs(dLat * -1.0 * prevDelta.dLon + prevDelta.dLat * dLon) / sqrt(dLat * dLat + dLon * dLon);
         if (distance < 0.5) {
-            ((DeltaCoord&)m_buffer.back()).dLat = dLat;
-            ((DeltaCoord&)m_buffer.back()).dLon = dLon;
+            currDelta = { dLat, dLon };
+            m_lastDelta = *(uint8_t*)(&currDelta);
+            put(m_size-1, m_lastDelta);
             ++m_stats.removedCoords;
+            m_decoded.lat += lat;
+            m_decoded.lon += lon;
+            m_mergeStart = { m_decoded.lat - dLat, m_decoded.lon - dLon };
+            m_mergeEnd = m_decoded;
+            m_merged = true;
             return;
         }
     }
 
-    m_buffer.push_back(*(uint8_t*)(&currDelta));
+    m_decoded.lat += lat;
+    m_decoded.lon += lon;
+    m_lastDelta = *(uint8_t*)(&currDelta);
+    m_lastNibble = true;
+    put(m_size++, m_lastDelta);
     ++m_stats.keptCoords;
 }
 
-std::vector<CayenneLPPPolyline::Point> CayenneLPPPolyline::douglasPeucker(const std::vector<Point> &pointList, double epsilon) {
-    if (pointList.size() < 2) {
-        return {};
+uint8_t CayenneLPPPolyline::escapeSize(int32_t lat, int32_t lon) {
+    // Smallest escape the delta fits into, 24 bit covers any coordinate
+    if (lat >= -128 && lat < 128 && lon >= -128 && lon < 128) {
+        return 3;
+    } else if (lat >= -2048 && lat < 2048 && lon >= -2048 && lon < 2048) {
+        return 4;
     }
+    return 7;
+}
 
-    std::vector<Point> out;
+void CayenneLPPPolyline::writeEscape(int32_t lat, int32_t lon) {
+    m_decoded.lat += lat;
+    m_decoded.lon += lon;
+    const uint8_t size = escapeSize(lat, lon);
+    if (size == 3) {
+        put(m_size++, LPP_POLYLINE_ESCAPE_8BIT);
+        put(m_size++, lat);
+        put(m_size++, lon);
+    } else if (size == 4) {
+        put(m_size++, LPP_POLYLINE_ESCAPE_12BIT);
+        put(m_size++, lat >> 4);
+        put(m_size++, (lat & 0x0F) << 4 | (lon >> 8 & 0x0F));
+        put(m_size++, lon);
+    } else {
+        put(m_size++, LPP_POLYLINE_ESCAPE_24BIT);
+        put(m_size++, lat >> 16); put(m_size++, lat >> 8); put(m_size++, lat);
+        put(m_size++, lon >> 16); put(m_size++, lon >> 8); put(m_size++, lon);
+    }
+    m_lastNibble = false;
+    ++m_stats.keptCoords;
+}
 
-    // Find the point with the maximum distance from line between start and end
-    double dmax = 0.0;
-    size_t index = 0;
-    size_t end = pointList.size()-1;
-    for (size_t i = 1; i < end; i++) {
-        double d = distance(pointList[i], pointList[0], pointList[end]);
-        if (d > dmax) {
-            index = i;
-            dmax = d;
+void CayenneLPPPolyline::writeVarint(uint32_t value) {
+    // 7 bits per byte, least significant first
+    while (value >= 0x80) {
+        put(m_size++, value | 0x80);
+        value >>= 7;
+    }
+    put(m_size++, value);
+    m_lastNibble = false;
+}
+
+void CayenneLPPPolyline::put(uint32_t index, uint8_t value) {
+    // Bytes beyond the capacity of the output span are counted, but not written
+    if (m_out) {
+        if (index < m_capacity) {
+            m_out[index] = value;
         }
+    } else {
+        if (index >= m_buffer.size()) {
+            m_buffer.resize(index + 1);
+        }
+        m_buffer[index] = value;
     }
+}
 
-    // If max distance is greater than epsilon, recursively simplify
-    if (dmax > epsilon) {
-        // Recursive call
-        std::vector<Point> recResults1;
-        std::vector<Point> recResults2;
-        std::vector<Point> firstLine(pointList.begin(), pointList.begin()+index+1);
-        std::vector<Point> lastLine(pointList.begin()+index, pointList.end());
-        recResults1 = douglasPeucker(firstLine, epsilon);
-        recResults2 = douglasPeucker(lastLine, epsilon);
+void CayenneLPPPolyline::douglasPeucker(const std::vector<Point>& coords, double epsilon) {
+    // Explicit stack of [first, last] ranges instead of recursion. Kept coords are
+    // marked in place, so no sub-ranges are copied.
+    m_keep.assign(coords.size(), 0);
+    segmentRanges(coords.size());
+    for (const auto& range : m_ranges) {
+        m_keep[range.first] = 1;
+        m_keep[range.second] = 1;
+    }
 
-        // Build the result list
-        out.assign(recResults1.begin(), recResults1.end()-1);
-        out.insert(out.end(), recResults2.begin(), recResults2.end());
+    const double epsilonSquared = epsilon * epsilon;
+    split(coords);
+    while (!m_ranges.empty()) {
+        const uint32_t first = m_ranges.back().first;
+        const uint32_t last = m_ranges.back().second;
+        m_ranges.pop_back();
 
-        if (out.size() < 2) {
-            return {};
+        // Find the point with the maximum distance from line between first and last
+        double dmax = 0.0;
+        const uint32_t index = maxDistance(first, last, dmax);
+
+        // If max distance is greater than epsilon, keep it and simplify both halves
+        if (dmax > epsilonSquared) {
+            m_keep[index] = 1;
+            m_ranges.emplace_back(index, last);
+            m_ranges.emplace_back(first, index);
         }
-    } else {
-        //Just return start and end points
-        out.clear();
-        out.push_back(pointList[0]);
-        out.push_back(pointList[end]);
+    }
+}
+
+void CayenneLPPPolyline::synchronizedDouglasPeucker(const std::vector<Point>& coords, double epsilon) {
+    if (!m_times) {
+        douglasPeucker(coords, epsilon);
+        return;
+    }
+
+    // Same splits as douglasPeucker, but a coord is compared with the position on
+    // the line at its time (synchronized euclidean distance). Stops and changes of
+    // speed are kept, not only changes of direction.
+    const std::vector<uint32_t>& times = *m_times;
+    m_keep.assign(coords.size(), 0);
+    segmentRanges(coords.size());
+    for (const auto& range : m_ranges) {
+        m_keep[range.first] = 1;
+        m_keep[range.second] = 1;
     }
 
-    return out;
+    const double epsilonSquared = epsilon * epsilon;
+    while (!m_ranges.empty()) {
+        const uint32_t first = m_ranges.back().first;
+        const uint32_t last = m_ranges.back().second;
+        m_ranges.pop_back();
+
+        const Point& start = coords[first];
+        const Point& end = coords[last];
+        const double duration = times[last] - times[first];
+        double dmax = 0.0;
+        uint32_t index = first;
+        for (uint32_t i = first + 1; i < last; ++i) {
+            const double ratio = duration > 0.0 ? (times[i] - times[first]) / duration : 0.0;
+            const double dLat = start.first + ratio * (end.first - start.first) - coords[i].first;
+            const double dLon = start.second + ratio * (end.second - start.second) - coords[i].second;
+            double d = dLat * dLat + dLon * dLon;
+            if (m_altitudes) {
+                const std::vector<double>& altitudes = *m_altitudes;
+                const double dAlt = (altitudes[first] + ratio * (altitudes[last] - altitudes[first]) - altitudes[i]) / MetresPerDegree;
+                d += dAlt * dAlt;
+            }
+            if (d > dmax) {
+                index = i;
+                dmax = d;
+            }
+        }
+
+        if (dmax > epsilonSquared) {
+            m_keep[index] = 1;
+            m_ranges.emplace_back(index, last);
+            m_ranges.emplace_back(first, index);
+        }
+    }
 }
 
-double CayenneLPPPolyline::distance(const Point& point, const Point& lineStart, const Point& lineEnd) {
-    double dLat = lineEnd.first - lineStart.first;
-    double dLon = lineEnd.second - lineStart.second;
+void CayenneLPPPolyline::split(const std::vector<Point>& coords) {
+    // Structure of arrays for the distance kernels
+    m_lat.resize(coords.size());
+    m_lon.resize(coords.size());
+    for (size_t i = 0; i < coords.size(); ++i) {
+        m_lat[i] = coords[i].first;
+        m_lon[i] = coords[i].second;
+    }
+    m_alt.clear();
+    if (m_altitudes) {
+        for (const double altitude : *m_altitudes) {
+            m_alt.push_back(altitude / MetresPerDegree);
+        }
+    }
+}
+
+uint32_t CayenneLPPPolyline::maxDistance(uint32_t first, uint32_t last, double& dmax) const {
+    if (!m_alt.empty()) {
+        return maxDistance3d(m_lat.data(), m_lon.data(), m_alt.data(), first, last, dmax);
+    }
+    return distanceKernel()(m_lat.data(), m_lon.data(), first, last, dmax);
+}
+
+void CayenneLPPPolyline::rank(const std::vector<Point>& coords) {
+    // Same splits as douglasPeucker, but down to the last coord. The importance of
+    // a coord is its squared distance, capped by the importance of the coord that
+    // split its range. Keeping all coords above epsilon² then equals douglasPeucker.
+    m_importance.assign(coords.size(), 0.0);
+    segmentRanges(coords.size());
+    for (const auto& range : m_ranges) {
+        m_importance[range.first] = std::numeric_limits<double>::infinity();
+        m_importance[range.second] = std::numeric_limits<double>::infinity();
+    }
+
+    split(coords);
+    while (!m_ranges.empty()) {
+        const uint32_t first = m_ranges.back().first;
+        const uint32_t last = m_ranges.back().second;
+        m_ranges.pop_back();
+
+        double dmax = 0.0;
+        const uint32_t index = maxDistance(first, last, dmax);
+
+        if (dmax > 0.0) {
+            m_importance[index] = std::min(dmax, std::min(m_importance[first], m_importance[last]));
+            m_ranges.emplace_back(index, last);
+            m_ranges.emplace_back(first, index);
+        }
+    }
+}
+
+void CayenneLPPPolyline::progressiveRank(const std::vector<Point>& coords, double minImportance) {
+    // Same importances as rank(), but the range with the largest distance is split
+    // first. When the budget is spent, the coords found so far are ranked and all
+    // others stay at 0, so any cut through the ranking is a valid simplification.
+    m_importance.assign(coords.size(), 0.0);
+    segmentRanges(coords.size());
+    for (const auto& range : m_ranges) {
+        m_importance[range.first] = std::numeric_limits<double>::infinity();
+        m_importance[range.second] = std::numeric_limits<double>::infinity();
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_budgetMicros);
+    uint32_t operations = 0;
+    bool spent = false;
+    const auto less = [](const Split& a, const Split& b) {
+        return a.distance < b.distance;
+    };
+    // Computes the farthest coord of a range and queues it. Returns false when out of budget.
+    const auto measure = [&](uint32_t first, uint32_t last) {
+        const uint32_t cost = last - first - 1;
+        if (!cost) {
+            return true;
+        }
+        if ((m_budgetOperations && cost > m_budgetOperations - operations)
+                || (m_budgetMicros && std::chrono::steady_clock::now() >= deadline)) {
+            return false;
+        }
+        operations += cost;
+        double dmax = 0.0;
+        const uint32_t index = maxDistance(first, last, dmax);
+        m_splits.push_back({ dmax, index, first, last });
+        std::push_heap(m_splits.begin(), m_splits.end(), less);
+        return true;
+    };
+
+    split(coords);
+    m_splits.clear();
+    for (const auto& range : m_ranges) {
+        spent = spent || !measure(range.first, range.second);
+    }
 
-    // Normalise
-    const double mag = sqrt(dLat * dLat + dLon * dLon);
-    if (mag > 0.0) {
-        dLat /= mag; dLon /= mag;
+    // Ranges measured before the budget was spent are still split, their halves are not measured
+    while (!m_splits.empty()) {
+        std::pop_heap(m_splits.begin(), m_splits.end(), less);
+        const Split top = m_splits.back();
+        m_splits.pop_back();
+
+        if (top.distance <= minImportance) {
+            break;
+        }
+
+        m_importance[top.index] = std::min(top.distance, std::min(m_importance[top.first], m_importance[top.last]));
+        spent = spent || !measure(top.first, top.index) || !measure(top.index, top.last);
+    }
+}
+
+void CayenneLPPPolyline::keepAbove(double minImportance) {
+    m_keep.resize(m_importance.size());
+    for (size_t i = 0; i < m_importance.size(); ++i) {
+        m_keep[i] = m_importance[i] > minImportance;
+    }
+}
+
+void CayenneLPPPolyline::visvalingamWhyatt(const std::vector<Point>& coords, double minArea) {
+    const uint32_t size = coords.size();
+    m_keep.assign(size, 1);
+    m_prev.resize(size);
+    m_next.resize(size);
+    // End points of segments have an infinite area and are never removed
+    m_areas.assign(size, std::numeric_limits<double>::infinity());
+    m_heap.clear();
+
+    // Min-heap of effective areas. Entries are not updated but pushed again,
+    // stale ones are detected by comparing with m_areas.
+    const auto greater = std::greater<std::pair<double, uint32_t>>();
+    segmentRanges(size);
+    for (const auto& range : m_ranges) {
+        for (uint32_t i = range.first + 1; i < range.second; ++i) {
+            m_prev[i] = i-1;
+            m_next[i] = i+1;
+            m_areas[i] = area(coords[i-1], coords[i], coords[i+1]);
+            m_heap.emplace_back(m_areas[i], i);
+        }
     }
+    std::make_heap(m_heap.begin(), m_heap.end(), greater);
 
-    const double pvx = point.first - lineStart.first;
-    const double pvy = point.second - lineStart.second;
+    while (!m_heap.empty()) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), greater);
+        const auto top = m_heap.back();
+        m_heap.pop_back();
 
-    // Get dot product (project pv onto normalized direction)
-    const double pvdot = dLat * pvx + dLon * pvy;
+        const uint32_t i = top.second;
+        if (!m_keep[i] || top.first != m_areas[i]) {
+            continue;
+        }
+        // All remaining points are significant
+        if (top.first >= minArea) {
+            break;
+        }
 
-    // Scale line direction vector
-    const double dsx = pvdot * dLat;
-    const double dsy = pvdot * dLon;
+        // Remove point and link its neighbours
+        m_keep[i] = 0;
+        const uint32_t prev = m_prev[i];
+        const uint32_t next = m_next[i];
+        m_next[prev] = next;
+        m_prev[next] = prev;
 
-    // Subtract this from pv
-    const double ax = pvx - dsx;
-    const double ay = pvy - dsy;
+        // Recompute neighbours. Their area must not fall below the one just removed,
+        // otherwise they would be removed before less significant points.
+        for (const uint32_t j : { prev, next }) {
+            if (std::isinf(m_areas[j])) {
+                continue;
+            }
+            m_areas[j] = std::max(area(coords[m_prev[j]], coords[j], coords[m_next[j]]), top.first);
+            m_heap.emplace_back(m_areas[j], j);
+            std::push_heap(m_heap.begin(), m_heap.end(), greater);
+        }
+    }
+}
+
+double CayenneLPPPolyline::area(const Point& a, const Point& b, const Point& c) {
+    return std::abs((b.first - a.first) * (c.second - a.second) - (c.first - a.first) * (b.second - a.second)) * 0.5;
+}
 
-    return sqrt(ax * ax + ay * ay);
+CayenneLPPPolyline::Point CayenneLPPPolyline::offset(const Point& point, const Point& lineStart, const Point& lineEnd) {
+    // Offset of the point from the closest point of the line segment
+    const double dLat = lineEnd.first - lineStart.first;
+    const double dLon = lineEnd.second - lineStart.second;
+    const double magSquared = dLat * dLat + dLon * dLon;
+
+    double t = 0.0;
+    if (magSquared > 0.0) {
+        t = ((point.first - lineStart.first) * dLat + (point.second - lineStart.second) * dLon) / magSquared;
+        t = std::max(0.0, std::min(1.0, t));
+    }
+    return { point.first - (lineStart.first + t * dLat), point.second - (lineStart.second + t * dLon) };
 }
 
 #endif
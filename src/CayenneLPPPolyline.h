@@ -10,6 +10,7 @@
 #ifndef CAYENNELPPPOLYLINE_H
 #define CAYENNELPPPOLYLINE_H
 
+#include <limits>
 #include <utility>
 #include <vector>
 // ESP-IDF framework
@@ -17,11 +18,27 @@
 #include <stdint.h>
 #endif
 
+#include "CayenneLPPPolylineEncoder.h"
+
+// Extended format: a nibble byte with dLat == -8 escapes a larger delta
+#define LPP_POLYLINE_ESCAPE_8BIT 0x08   // followed by 8 bit lat and lon deltas
+#define LPP_POLYLINE_ESCAPE_12BIT 0x18  // followed by 12 bit lat and lon deltas
+#define LPP_POLYLINE_ESCAPE_24BIT 0x28  // followed by 24 bit lat and lon deltas
+#define LPP_POLYLINE_SEGMENT_BREAK 0xF8 // next delta starts a new segment, relative to the end of the previous one
+// Extended format flags
+#define LPP_POLYLINE_FLAG_TIME 0x01     // 4 byte base unix time in header, varint seconds after each delta
+#define LPP_POLYLINE_FLAG_ALTITUDE 0x02 // 3 byte base altitude 0.01 m in header, zigzag varint 0.1 m after each delta
+// Altitudes must be within +/- this value in 0.01 m
+#define LPP_POLYLINE_ALTITUDE_LIMIT 8388608
+// Number of coords the span decoder unpacks per step
+#define LPP_POLYLINE_DECODE_CHUNK 64
+
 struct DeltaCoord;
 
 class CayenneLPPPolyline {
 public:
     enum Precision : uint8_t {
+        PrecAuto    = 0,    ///< Finest precision that fits into maxSize, never sent
         //Reserved    = 200,
         //Prec0_00001 = 224,
         //Prec0_000025 = 225,
@@ -50,17 +67,66 @@ public:
     enum Simplification {
         None = 0,   ///< No simplifaction applied
         PerpendicularDistance = 1,  ///< A simple and fast algorithm
-        DouglasPeucker = 2  ///< A sophisticated but complex algorithm
+        DouglasPeucker = 2, ///< A sophisticated but complex algorithm
+        VisvalingamWhyatt = 3,  ///< Removes least significant points first, yields smoother tracks
+        DouglasPeuckerFit = 4,  ///< Douglas-Peucker with the tolerance chosen to fit the whole track into maxSize
+        SynchronizedDouglasPeucker = 5, ///< Douglas-Peucker on the synchronized euclidean distance, keeps timing. Without times Douglas-Peucker.
+        ProgressiveDouglasPeucker = 6   ///< Douglas-Peucker splitting the largest distance first, stops when the budget is spent (see setSimplificationBudget). Fits the track into maxSize.
     };
 
+    /**
+     * @brief Statistics of the last encode. Errors are distances of the input coords
+     *  up to the last encoded one from the decoded track, in metres and in quantization
+     *  steps of the factor. They are tracked while encoding, no decode is needed. Coords
+     *  removed by simplification are measured against the line between their kept
+     *  neighbours, ignoring the rounding of intermediates in between.
+     */
     struct Stats {
         uint32_t keptCoords = 0;
         uint32_t addedCoords = 0;
         uint32_t removedCoords = 0;
+        uint32_t filteredCoords = 0;    ///< Dropped or merged by the pre-filter (see setFilter)
+        double maxError = 0.0;          ///< Metres
+        double rmsError = 0.0;          ///< Metres
+        double maxErrorSteps = 0.0;     ///< Quantization steps
+        double rmsErrorSteps = 0.0;     ///< Quantization steps
+        double compressionRatio = 0.0;  ///< Raw size (6 bytes per coord, 4 per time, 3 per altitude) / encoded size
     };
 
     using Point = std::pair<double, double>;
 
+    /**
+     * @brief Pre-filter against GPS jitter, applied by encode before simplification.
+     *  Runs in one pass with constant state. Fixes are gated against the last accepted
+     *  one, then accepted fixes within the radius of the running centroid are merged.
+     *  A stop is sent as its centroid, at its first and last time if the track has times.
+     */
+    struct Filter {
+        double stationaryRadius = 0.0;  ///< Merge radius in metres, 0 disables clustering
+        double maxSpeed = 0.0;          ///< Metres per second, or per fix without times. 0 disables gating.
+                                        ///< A faster fix is dropped if the next one is within this speed
+                                        ///< of the last accepted fix again (a single outlier).
+    };
+
+    /**
+     * @brief A coordinate in units of 1/ScaleFactor (0.0001) degrees.
+     */
+    struct FixedPoint {
+        int32_t lat = 0;
+        int32_t lon = 0;
+    };
+
+    /**
+     * @brief A track with the unix time and altitude of every coordinate.
+     */
+    struct Trajectory {
+        std::vector<Point> coords;
+        std::vector<uint32_t> times;    ///< One per coord, non-decreasing, or empty
+        std::vector<double> altitudes;  ///< One per coord in metres, or empty
+    };
+
+    static constexpr double ScaleFactor = 10000.0;
+
     CayenneLPPPolyline(uint32_t size);
 
     /**
@@ -73,24 +139,172 @@ public:
      *  This value scales linearly, so a value of 10 would result in a precision of 0.001 degrees.
      *  You can set values as high as 199.
      *  Special values start from 227 (see CayenneLPPPolyline::Precision).
+     *  0 selects one of the special values automatically (see CayenneLPPPolyline::PrecAuto).
      *  Values 200-226 and 240-255 are reserved for future usage.
      * @param simplification The simplification to apply to coordinates.
+     * @param maxSize The byte budget for PrecAuto and DouglasPeuckerFit. 0 uses the size given at construction.
+     *  Other simplifications stop adding coordinates once the size given at construction is reached.
      * @return buffer The byte buffer which results from serialization.
      */
     std::vector<uint8_t> encode(const std::vector<Point>& coords,
                                 uint8_t factor,
-                                Simplification simplification = DouglasPeucker);
+                                Simplification simplification = DouglasPeucker,
+                                uint32_t maxSize = 0);
 
     /**
      * @brief encode Encodes a set of GPS Coordinates into a byte buffer.
      * @param coords The set of coords to be serialized and compressed.
      * @param precision This defines the precision for delta compression (see CayenneLPPPolyline::Precision).
+     *  PrecAuto selects the finest precision whose simplified output fits into maxSize.
      * @param simplification The simplification to apply to coordinates.
+     * @param maxSize The byte budget for PrecAuto and DouglasPeuckerFit. 0 uses the size given at construction.
      * @return buffer The byte buffer which results from serialization.
      */
     std::vector<uint8_t> encode(const std::vector<Point>& coords,
                                 Precision precision = Prec0_0001,
-                                Simplification simplification = DouglasPeucker);
+                                Simplification simplification = DouglasPeucker,
+                                uint32_t maxSize = 0);
+
+    /**
+     * @brief encode Encodes a set of GPS Coordinates directly into a byte span, without heap allocations
+     *  once the internal scratch space has grown.
+     * @param coords The set of coords to be serialized and compressed.
+     * @param factor This factor is used as quantization factor for delta compression (see above).
+     * @param simplification The simplification to apply to coordinates.
+     * @param out The output span.
+     * @param capacity The size of the output span.
+     * @param maxSize The byte budget for PrecAuto and DouglasPeuckerFit. 0 uses the size given at construction.
+     * @return size The encoded size. If larger than capacity, only the first capacity bytes are
+     *  written and the output must be discarded.
+     */
+    uint32_t encode(const std::vector<Point>& coords,
+                    uint8_t factor,
+                    Simplification simplification,
+                    uint8_t* out,
+                    uint32_t capacity,
+                    uint32_t maxSize = 0);
+    uint32_t encode(const std::vector<Point>& coords,
+                    Precision precision,
+                    Simplification simplification,
+                    uint8_t* out,
+                    uint32_t capacity,
+                    uint32_t maxSize = 0);
+
+    /**
+     * @brief encodeExtended Encodes GPS Coordinates into the extended format (LPP_POLYLINE_EXT).
+     *  Deltas that do not fit into a nibble are escaped as 8, 12 or 24 bit deltas
+     *  instead of being split into intermediate coordinates, which is much more
+     *  compact for fast movement. Parameters are the same as for encode.
+     * @return buffer The byte buffer which results from serialization.
+     */
+    std::vector<uint8_t> encodeExtended(const std::vector<Point>& coords,
+                                        uint8_t factor,
+                                        Simplification simplification = DouglasPeucker,
+                                        uint32_t maxSize = 0);
+    std::vector<uint8_t> encodeExtended(const std::vector<Point>& coords,
+                                        Precision precision = Prec0_0001,
+                                        Simplification simplification = DouglasPeucker,
+                                        uint32_t maxSize = 0);
+
+    /**
+     * @brief encodeExtended Encodes GPS Coordinates into the extended format, directly into a byte span.
+     * @return size The encoded size. If larger than capacity, the output must be discarded.
+     */
+    uint32_t encodeExtended(const std::vector<Point>& coords,
+                            uint8_t factor,
+                            Simplification simplification,
+                            uint8_t* out,
+                            uint32_t capacity,
+                            uint32_t maxSize = 0);
+    uint32_t encodeExtended(const std::vector<Point>& coords,
+                            Precision precision,
+                            Simplification simplification,
+                            uint8_t* out,
+                            uint32_t capacity,
+                            uint32_t maxSize = 0);
+
+    /**
+     * @brief encodeExtended Encodes a trajectory into the extended format, with delta times
+     *  and altitudes per coordinate if given. Every kept coordinate is sent, large deltas are
+     *  always escaped. Douglas-Peucker simplifications take altitudes into account,
+     *  one degree of latitude corresponding to 111.32 km.
+     * @return buffer The byte buffer which results from serialization, empty if times or altitudes are invalid.
+     */
+    std::vector<uint8_t> encodeExtended(const Trajectory& trajectory,
+                                        uint8_t factor,
+                                        Simplification simplification = SynchronizedDouglasPeucker,
+                                        uint32_t maxSize = 0);
+    std::vector<uint8_t> encodeExtended(const Trajectory& trajectory,
+                                        Precision precision = Prec0_0001,
+                                        Simplification simplification = SynchronizedDouglasPeucker,
+                                        uint32_t maxSize = 0);
+    uint32_t encodeExtended(const Trajectory& trajectory,
+                            uint8_t factor,
+                            Simplification simplification,
+                            uint8_t* out,
+                            uint32_t capacity,
+                            uint32_t maxSize = 0);
+    uint32_t encodeExtended(const Trajectory& trajectory,
+                            Precision precision,
+                            Simplification simplification,
+                            uint8_t* out,
+                            uint32_t capacity,
+                            uint32_t maxSize = 0);
+
+    /**
+     * @brief encodeExtended Encodes several track segments into one field of the extended format.
+     *  Later segments start with a segment break and a delta to the end of the previous
+     *  segment instead of a full header. Segments are simplified independently, their
+     *  end points are always kept. Empty segments are skipped.
+     * @return buffer The byte buffer which results from serialization.
+     */
+    std::vector<uint8_t> encodeExtended(const std::vector<std::vector<Point>>& segments,
+                                        uint8_t factor,
+                                        Simplification simplification = DouglasPeucker,
+                                        uint32_t maxSize = 0);
+    std::vector<uint8_t> encodeExtended(const std::vector<std::vector<Point>>& segments,
+                                        Precision precision = Prec0_0001,
+                                        Simplification simplification = DouglasPeucker,
+                                        uint32_t maxSize = 0);
+    uint32_t encodeExtended(const std::vector<std::vector<Point>>& segments,
+                            uint8_t factor,
+                            Simplification simplification,
+                            uint8_t* out,
+                            uint32_t capacity,
+                            uint32_t maxSize = 0);
+    uint32_t encodeExtended(const std::vector<std::vector<Point>>& segments,
+                            Precision precision,
+                            Simplification simplification,
+                            uint8_t* out,
+                            uint32_t capacity,
+                            uint32_t maxSize = 0);
+
+    /**
+     * @brief begin Starts encoding coordinates one by one, e.g. live GPS fixes.
+     *  Memory is bounded by the size given at construction, whatever the track length.
+     *  Simplifications other than None and PerpendicularDistance apply an online
+     *  Douglas-Peucker over the last LPP_POLYLINE_WINDOW coords.
+     * @param first The first coordinate.
+     * @param factor The quantization factor (see encode). PrecAuto is not supported.
+     * @param simplification The simplification to apply to coordinates.
+     * @return true on success, false if factor or coordinate is invalid.
+     */
+    bool begin(const Point& first, uint8_t factor, Simplification simplification = DouglasPeucker);
+    bool begin(const Point& first, Precision precision = Prec0_0001, Simplification simplification = DouglasPeucker);
+
+    /**
+     * @brief push Adds the next coordinate to the stream started by begin.
+     * @param coord The coordinate.
+     * @return true if accepted, false if not started, the buffer is full or the coordinate is invalid.
+     */
+    bool push(const Point& coord);
+
+    /**
+     * @brief finish Completes the stream started by begin.
+     * @return buffer The byte buffer which results from serialization. Empty if not
+     *  started or if a last jump exceeded the size given at construction.
+     */
+    std::vector<uint8_t> finish();
 
     /**
      * @brief decode Decodes a byte buffer back to a set of GPS Coordinates.
@@ -99,26 +313,163 @@ public:
      */
     static std::vector<std::pair<double, double>> decode(const std::vector<uint8_t>& buffer);
 
+    /**
+     * @brief decode Decodes a byte span back to GPS Coordinates without intermediate copies.
+     * @param buffer The byte span to be deserialized.
+     * @param size The size of the span.
+     * @param out Output iterator receiving CayenneLPPPolyline::Point values, e.g. a
+     *  std::back_inserter or a pointer to getCount() preallocated points.
+     * @return out The output iterator past the last written coordinate.
+     */
+    template <typename OutputIt>
+    static OutputIt decode(const uint8_t* buffer, uint32_t size, OutputIt out) {
+        FixedPoint prev;
+        FixedPoint chunk[LPP_POLYLINE_DECODE_CHUNK];
+        uint32_t count = 0;
+        for (uint32_t index = 0; (count = decodeChunk(buffer, size, index, prev, chunk)); index += count) {
+            for (uint32_t i = 0; i < count; ++i) {
+                *out++ = Point { chunk[i].lat / ScaleFactor, chunk[i].lon / ScaleFactor };
+            }
+        }
+        return out;
+    }
+
+    /**
+     * @brief decodeFixed Decodes a byte span to fixed point coordinates, avoiding any floating point.
+     * @param buffer The byte span to be deserialized.
+     * @param size The size of the span.
+     * @param out Output iterator receiving CayenneLPPPolyline::FixedPoint values.
+     * @return out The output iterator past the last written coordinate.
+     */
+    template <typename OutputIt>
+    static OutputIt decodeFixed(const uint8_t* buffer, uint32_t size, OutputIt out) {
+        FixedPoint prev;
+        FixedPoint chunk[LPP_POLYLINE_DECODE_CHUNK];
+        uint32_t count = 0;
+        for (uint32_t index = 0; (count = decodeChunk(buffer, size, index, prev, chunk)); index += count) {
+            for (uint32_t i = 0; i < count; ++i) {
+                *out++ = chunk[i];
+            }
+        }
+        return out;
+    }
+
+    /**
+     * @brief decodeExtended Decodes a byte span in the extended format back to GPS Coordinates.
+     * @param buffer The byte span to be deserialized.
+     * @param size The size of the span.
+     * @param coords Cleared and filled with the coordinates, its storage is reused.
+     * @param times If set, cleared and filled with the unix times. Stays empty if the span has none.
+     * @param altitudes If set, cleared and filled with the altitudes in metres. Stays empty if the span has none.
+     * @param segments If set, cleared and filled with the indices of coords that start a new segment.
+     * @param truncated If set, tells whether a failure is due to the span ending within a record.
+     * @return true on success, false if the span is truncated or uses unknown features.
+     */
+    static bool decodeExtended(const uint8_t* buffer, uint32_t size, std::vector<Point>& coords,
+                               std::vector<uint32_t>* times = nullptr, std::vector<double>* altitudes = nullptr,
+                               std::vector<uint32_t>* segments = nullptr, bool* truncated = nullptr);
+    static bool decodeExtended(const uint8_t* buffer, uint32_t size, Trajectory& trajectory);
+    static bool decodeExtended(const uint8_t* buffer, uint32_t size, std::vector<std::vector<Point>>& segments);
+
+    /**
+     * @brief decodeExtended Decodes a polyline in the extended format back to GPS Coordinates.
+     * @param buffer The polyline to be deserialized.
+     * @return coords The coordinates, empty if the polyline is malformed.
+     */
+    static std::vector<Point> decodeExtended(const std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief getCount Returns the number of coordinates a decode of the byte span yields.
+     * @param buffer The byte span to be deserialized.
+     * @param size The size of the span.
+     * @return count The number of coordinates, 0 if the span is no valid polyline.
+     */
+    static uint32_t getCount(const uint8_t* buffer, uint32_t size);
+
     /**
      * @brief getEncodeStats Obtain some statistics from the encoding process.
      * @return stats The resulting statistics from encoding.
      */
     Stats getEncodeStats() const;
 
+    /**
+     * @brief setSimplificationBudget Bounds the work of ProgressiveDouglasPeucker.
+     *  When the budget is spent, the coords found so far are encoded.
+     * @param operations The maximum number of point to line distances to compute, 0 for no limit.
+     * @param micros The maximum time in microseconds, 0 for no limit.
+     */
+    void setSimplificationBudget(uint32_t operations, uint32_t micros = 0);
+
+    /**
+     * @brief setFilter Sets the pre-filter of encode and encodeExtended. A default Filter disables it.
+     */
+    void setFilter(const Filter& filter);
+
 private:
+    struct Split {
+        double distance;
+        uint32_t index;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    static uint32_t decodeChunk(const uint8_t* buffer, uint32_t size, uint32_t index,
+                                FixedPoint& prev, FixedPoint* chunk);
+
     void reset();
+    void encodeCoords(const std::vector<Point>& coords, uint8_t factor, Simplification simplification, uint32_t maxSize);
+    void encodeTrack(const std::vector<Point>& coords, uint8_t factor, Simplification simplification, uint32_t maxSize);
+    void filter(const std::vector<Point>& coords);
+    bool setTrajectory(const Trajectory& trajectory);
+    void setSegments(const std::vector<std::vector<Point>>& segments);
+    void segmentRanges(uint32_t size);
+    void write(const std::vector<Point>& coords, uint8_t factor, Simplification simplification, uint32_t limit);
+    uint8_t selectFactor(const std::vector<Point>& coords, Simplification simplification, uint32_t maxSize);
+    void fit(const std::vector<Point>& coords, uint8_t factor, uint32_t maxSize, bool ranked,
+             double minImportance = std::numeric_limits<double>::lowest());
     static double getFactor(uint8_t factor);
     void push(double lat, double lon, bool optimize);
     void pushFirst(double lat, double lon, uint8_t factor);
 
     void writeHeader(int32_t lat, int32_t lon, uint8_t factor);
+    uint8_t headerSize() const;
     void writeDelta(int8_t lat, int8_t lon, bool optimize);
+    void writeEscape(int32_t lat, int32_t lon);
+    static uint8_t escapeSize(int32_t lat, int32_t lon);
+    void writeVarint(uint32_t value);
+    void put(uint32_t index, uint8_t value);
 
-    static std::vector<Point> douglasPeucker(const std::vector<Point>& pointList, double epsilon);
-    static double distance(const Point& point, const Point& lineStart, const Point& lineEnd);
+    void douglasPeucker(const std::vector<Point>& coords, double epsilon);
+    void synchronizedDouglasPeucker(const std::vector<Point>& coords, double epsilon);
+    void rank(const std::vector<Point>& coords);
+    void progressiveRank(const std::vector<Point>& coords, double minImportance);
+    void split(const std::vector<Point>& coords);
+    uint32_t maxDistance(uint32_t first, uint32_t last, double& dmax) const;
+    void keepAbove(double minImportance);
+    static Point offset(const Point& point, const Point& lineStart, const Point& lineEnd);
+    void visvalingamWhyatt(const std::vector<Point>& coords, double minArea);
+    static double area(const Point& a, const Point& b, const Point& c);
 
     const uint32_t m_maxSize = 0;
-    std::vector<uint8_t> m_buffer;
+    std::vector<uint8_t> m_buffer;  ///< Output of the vector API
+
+    // Output span, m_buffer is used if not set
+    uint8_t* m_out = nullptr;
+    uint32_t m_capacity = 0;
+    uint32_t m_size = 0;
+    uint8_t m_lastDelta = 0;
+    bool m_lastNibble = false;  ///< Last record is a nibble delta and may be merged
+    bool m_extended = false;    ///< Writing the extended format
+    const std::vector<uint32_t>* m_times = nullptr;    ///< Times of the trajectory being encoded
+    const std::vector<double>* m_altitudes = nullptr;  ///< Altitudes of the trajectory being encoded
+    uint8_t m_flags = 0;        ///< LPP_POLYLINE_FLAG_* of the trajectory being encoded
+    std::vector<Point> m_segmentCoords; ///< Coords of all segments being encoded
+    std::vector<uint32_t> m_breaks;     ///< Indices of coords starting a new segment
+    bool m_break = false;       ///< Pushing the start of a segment
+    FixedPoint m_decoded;       ///< Decoded position after the last record, in steps of the factor
+    FixedPoint m_mergeStart;    ///< Start of the last merged record
+    FixedPoint m_mergeEnd;      ///< End of the last merged record
+    bool m_merged = false;      ///< A record was merged since this was reset
 
     double m_prevLat = 0.0;
     double m_prevLon = 0.0;
@@ -127,6 +478,31 @@ private:
     double m_errLon = 0.0;
 
     Stats m_stats;
+
+    uint32_t m_budgetOperations = 0;
+    uint32_t m_budgetMicros = 0;
+    Filter m_filter;
+
+    // Streaming state
+    CayenneLPPPolylineEncoder m_stream;
+    std::vector<uint8_t> m_streamBuffer;
+
+    // Scratch space of the simplification, kept to avoid reallocations
+    std::vector<uint8_t> m_keep;
+    std::vector<std::pair<uint32_t, uint32_t>> m_ranges;
+    std::vector<double> m_lat;
+    std::vector<double> m_lon;
+    std::vector<double> m_alt;
+    std::vector<uint32_t> m_prev;
+    std::vector<uint32_t> m_next;
+    std::vector<double> m_areas;
+    std::vector<std::pair<double, uint32_t>> m_heap;
+    std::vector<double> m_importance;
+    std::vector<uint32_t> m_order;
+    std::vector<Split> m_splits;
+    std::vector<Point> m_filterCoords;
+    std::vector<uint32_t> m_filterTimes;
+    std::vector<double> m_filterAltitudes;
 };
 
 #endif // CAYENNELPPPOLYLINE_H
@@ -0,0 +1,71 @@
+/*
+ * CayenneLPP - CayenneLPP Polyline Batch Encoder
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+// Host only
+#if !defined(ARDUINO) && !defined(IDF_VER)
+#include "CayenneLPPPolylineBatch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// Tracks claimed by a thread at once
+#define BATCH_CHUNK 16
+
+CayenneLPPPolylineBatch::CayenneLPPPolylineBatch(uint32_t size, uint32_t threads)
+    : m_encoders(threads ? threads : std::max(std::thread::hardware_concurrency(), 1U), CayenneLPPPolyline(size)) {
+}
+
+void CayenneLPPPolylineBatch::encode(const std::vector<Track>& tracks,
+                                     std::vector<Result>& results,
+                                     uint8_t factor,
+                                     CayenneLPPPolyline::Simplification simplification,
+                                     uint32_t maxSize) {
+    results.resize(tracks.size());
+
+    // Threads claim chunks of tracks, so long and short tracks balance out
+    std::atomic<size_t> next { 0 };
+    const auto work = [&](CayenneLPPPolyline& encoder) {
+        for (size_t begin; (begin = next.fetch_add(BATCH_CHUNK)) < tracks.size(); ) {
+            const size_t end = std::min(begin + BATCH_CHUNK, tracks.size());
+            for (size_t i = begin; i < end; ++i) {
+                // Encode into the previous buffer, grow only if it is too small
+                auto& buffer = results[i].buffer;
+                buffer.resize(std::max<size_t>(buffer.capacity(), 64));
+                uint32_t size = encoder.encode(tracks[i], factor, simplification, buffer.data(), buffer.size(), maxSize);
+                if (size > buffer.size()) {
+                    buffer.resize(size);
+                    size = encoder.encode(tracks[i], factor, simplification, buffer.data(), buffer.size(), maxSize);
+                }
+                buffer.resize(size);
+                results[i].stats = encoder.getEncodeStats();
+            }
+        }
+    };
+
+    // Calling thread works as well
+    const size_t threadCount = std::min<size_t>(m_encoders.size(), (tracks.size() + BATCH_CHUNK - 1) / BATCH_CHUNK);
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < threadCount; ++t) {
+        threads.emplace_back(work, std::ref(m_encoders[t]));
+    }
+    work(m_encoders[0]);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void CayenneLPPPolylineBatch::encode(const std::vector<Track>& tracks,
+                                     std::vector<Result>& results,
+                                     CayenneLPPPolyline::Precision precision,
+                                     CayenneLPPPolyline::Simplification simplification,
+                                     uint32_t maxSize) {
+    encode(tracks, results, static_cast<uint8_t>(precision), simplification, maxSize);
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * CayenneLPP - CayenneLPP Polyline Batch Encoder
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef CAYENNELPPPOLYLINEBATCH_H
+#define CAYENNELPPPOLYLINEBATCH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "CayenneLPPPolyline.h"
+
+/**
+ * @brief Encodes many tracks in parallel, e.g. to regenerate polylines for
+ *  simulations and replays. Every thread has its own CayenneLPPPolyline, so
+ *  scratch space and output buffers are reused across tracks and calls.
+ */
+class CayenneLPPPolylineBatch {
+public:
+    using Track = std::vector<CayenneLPPPolyline::Point>;
+
+    struct Result {
+        std::vector<uint8_t> buffer;    ///< The encoded polyline
+        CayenneLPPPolyline::Stats stats;
+    };
+
+    /**
+     * @brief CayenneLPPPolylineBatch Creates a batch encoder.
+     * @param size The maximum size of an encoded track (see CayenneLPPPolyline).
+     * @param threads Number of encoder threads. 0 uses all cores.
+     */
+    CayenneLPPPolylineBatch(uint32_t size, uint32_t threads = 0);
+
+    /**
+     * @brief encode Encodes all tracks, with the same parameters as CayenneLPPPolyline::encode.
+     * @param tracks The tracks to encode.
+     * @param results Resized to the number of tracks and filled in track order.
+     *  Buffers of a previous call are reused.
+     * @param factor The quantization factor.
+     * @param simplification The simplification to apply to coordinates.
+     * @param maxSize The byte budget for PrecAuto and DouglasPeuckerFit.
+     */
+    void encode(const std::vector<Track>& tracks,
+                std::vector<Result>& results,
+                uint8_t factor,
+                CayenneLPPPolyline::Simplification simplification = CayenneLPPPolyline::DouglasPeucker,
+                uint32_t maxSize = 0);
+
+    void encode(const std::vector<Track>& tracks,
+                std::vector<Result>& results,
+                CayenneLPPPolyline::Precision precision = CayenneLPPPolyline::Prec0_0001,
+                CayenneLPPPolyline::Simplification simplification = CayenneLPPPolyline::DouglasPeucker,
+                uint32_t maxSize = 0);
+
+private:
+    std::vector<CayenneLPPPolyline> m_encoders;
+};
+
+#endif // CAYENNELPPPOLYLINEBATCH_H
@@ -0,0 +1,197 @@
+/*
+ * CayenneLPP - CayenneLPP Heap-free Polyline Encoder
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#include "CayenneLPPPolylineEncoder.h"
+
+#include <math.h>
+
+constexpr double CayenneLPPPolylineEncoder::ScaleFactor;
+constexpr double CayenneLPPPolylineEncoder::s_precisions[];
+
+static inline double absolute(double value) {
+    return value < 0.0 ? -value : value;
+}
+
+static inline int32_t roundToInt(double value) {
+    return lround(value);
+}
+
+bool CayenneLPPPolylineEncoder::begin(uint8_t* out, uint16_t capacity, double lat, double lon,
+                                      uint8_t factor, uint8_t simplification) {
+    m_out = out;
+    m_capacity = capacity;
+    m_size = 0;
+    m_lastDelta = 0;
+    m_lastNibble = false;
+    m_streaming = false;
+    m_windowSize = 0;
+
+    m_dFactor = getFactor(factor);
+    if (m_dFactor == 0.0 || absolute(lat) > 90.0 || absolute(lon) > 180.0) {
+        return false;
+    }
+
+    const double epsilon = m_dFactor/ScaleFactor * 0.5;
+    m_epsilonSquared = epsilon * epsilon;
+    m_simplification = simplification;
+    m_factor = factor;
+    m_first = { lat, lon };
+    m_anchor = m_first;
+    m_streaming = true;
+
+    pushFirst(lat * ScaleFactor / m_dFactor, lon * ScaleFactor / m_dFactor);
+
+    return true;
+}
+
+bool CayenneLPPPolylineEncoder::push(double lat, double lon) {
+    if (!m_streaming || m_size >= m_capacity) {
+        return false;
+    }
+
+    // Latitude -/+ 90
+    // Longitude -/+ 180
+    if (absolute(lat) > 90.0 || absolute(lon) > 180.0) {
+        return false;
+    }
+
+    const Coord coord { lat, lon };
+    if (m_simplification == None || m_simplification == PerpendicularDistance) {
+        pushStream(coord);
+        return true;
+    }
+
+    // Opening window: coords are held back as long as the line from the anchor
+    // to the newest coord passes all of them within epsilon. Otherwise the
+    // previous coord becomes the new anchor.
+    if (m_windowSize) {
+        bool within = m_windowSize < LPP_POLYLINE_WINDOW;
+        for (uint8_t i = 0; within && i < m_windowSize; ++i) {
+            within = distanceSquared(m_window[i], m_anchor, coord) <= m_epsilonSquared;
+        }
+        if (!within) {
+            m_anchor = m_window[m_windowSize-1];
+            m_windowSize = 0;
+            pushStream(m_anchor);
+        }
+    }
+    m_window[m_windowSize++] = coord;
+
+    return true;
+}
+
+uint32_t CayenneLPPPolylineEncoder::finish() {
+    if (!m_streaming) {
+        return 0;
+    }
+
+    if (m_windowSize && m_size < m_capacity) {
+        pushStream(m_window[m_windowSize-1]);
+    }
+    m_windowSize = 0;
+    m_streaming = false;
+
+    // Write final header
+    pushFirst(m_first.lat * ScaleFactor / m_dFactor, m_first.lon * ScaleFactor / m_dFactor);
+
+    return m_size;
+}
+
+void CayenneLPPPolylineEncoder::pushFirst(double lat, double lon) {
+    const int32_t roundLat = roundToInt(lat);
+    const int32_t roundLon = roundToInt(lon);
+
+    writeHeader(roundLat, roundLon);
+
+    m_errLat = (lat - roundLat);
+    m_errLon = (lon - roundLon);
+
+    m_prevLat = lat;
+    m_prevLon = lon;
+}
+
+void CayenneLPPPolylineEncoder::pushStream(const Coord& coord) {
+    pushScaled(coord.lat * ScaleFactor / m_dFactor, coord.lon * ScaleFactor / m_dFactor,
+               m_simplification == PerpendicularDistance);
+}
+
+void CayenneLPPPolylineEncoder::pushScaled(double lat, double lon, bool optimize) {
+    walk(lat, lon, m_prevLat, m_prevLon, m_errLat, m_errLon,
+         [this, optimize](int32_t roundLat, int32_t roundLon, double, double, bool) {
+        // Once the polyline does not fit, the rest of a far jump is not computed.
+        // Ignore items with zero delta.
+        if (m_size > m_capacity || (roundLat == 0 && roundLon == 0)) {
+            return true;
+        }
+        // Delta fits into one nibble, push it
+        if (roundLat > -8 && roundLat < 8 && roundLon > -8 && roundLon < 8) {
+            writeDelta(roundLat, roundLon, optimize);
+            return true;
+        }
+        // Otherwise compute intermediates
+        return false;
+    });
+}
+
+void CayenneLPPPolylineEncoder::writeHeader(int32_t lat, int32_t lon) {
+    if (m_size < 8) {
+        m_size = 8;
+    }
+    put(0, m_size);
+    put(1, m_factor);
+    put(2, lat >> 16); put(3, lat >> 8); put(4, lat);
+    put(5, lon >> 16); put(6, lon >> 8); put(7, lon);
+}
+
+void CayenneLPPPolylineEncoder::writeDelta(int8_t lat, int8_t lon, bool optimize) {
+    // Latitude in the low nibble, longitude in the high nibble
+    const int8_t prevLat = static_cast<int8_t>(m_lastDelta << 4) >> 4;
+    const int8_t prevLon = static_cast<int8_t>(m_lastDelta) >> 4;
+
+    // This is a cheap optimization as an alternative to Douglas-Peucker
+    // Check if the sum of this and next delta is within range
+    const int8_t dLat = prevLat + lat;
+    const int8_t dLon = prevLon + lon;
+    if (optimize && m_lastNibble && dLat > -8 && dLat < 8 && dLon > -8 && dLon < 8) {
+        // Check if previous delta only differs slightly from straight line to current delta
+        const double distance = absolute(dLat * -1.0 * prevLon + prevLat * dLon) / sqrt(dLat * dLat + dLon * dLon);
+        if (distance < 0.5) {
+            m_lastDelta = (dLat & 0x0F) | static_cast<uint8_t>(dLon) << 4;
+            put(m_size-1, m_lastDelta);
+            return;
+        }
+    }
+
+    m_lastDelta = (lat & 0x0F) | static_cast<uint8_t>(lon) << 4;
+    m_lastNibble = true;
+    put(m_size++, m_lastDelta);
+}
+
+void CayenneLPPPolylineEncoder::put(uint32_t index, uint8_t value) {
+    // Bytes beyond the capacity are counted, but not written
+    if (index < m_capacity) {
+        m_out[index] = value;
+    }
+}
+
+double CayenneLPPPolylineEncoder::distanceSquared(const Coord& point, const Coord& lineStart, const Coord& lineEnd) {
+    const double dLat = lineEnd.lat - lineStart.lat;
+    const double dLon = lineEnd.lon - lineStart.lon;
+
+    const double pvx = point.lat - lineStart.lat;
+    const double pvy = point.lon - lineStart.lon;
+
+    // Degenerated line, distance to its start
+    const double magSquared = dLat * dLat + dLon * dLon;
+    if (magSquared <= 0.0) {
+        return pvx * pvx + pvy * pvy;
+    }
+
+    // Cross product is the parallelogram area, divided by the base yields the height
+    const double cross = dLat * pvy - dLon * pvx;
+    return cross * cross / magSquared;
+}
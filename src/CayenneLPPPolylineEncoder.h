@@ -0,0 +1,227 @@
+/*
+ * CayenneLPP - CayenneLPP Heap-free Polyline Encoder
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef CAYENNELPPPOLYLINEENCODER_H
+#define CAYENNELPPPOLYLINEENCODER_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Number of coords the streaming encoder holds back for simplification.
+// Each costs two doubles of RAM, so boards get a smaller window.
+#ifndef LPP_POLYLINE_WINDOW
+#ifdef ARDUINO
+#define LPP_POLYLINE_WINDOW 16
+#else
+#define LPP_POLYLINE_WINDOW 32
+#endif
+#endif
+// Maximum nesting of intermediate coords while pushing one coord, see walk
+#define LPP_POLYLINE_PUSH_DEPTH 3
+
+/**
+ * @brief Encodes coordinates one by one into a caller provided buffer, in the
+ *  LPP_POLYLINE format of CayenneLPPPolyline. Uses neither the heap nor the STL,
+ *  so it builds for Arduino and AVR. RAM use is fixed by LPP_POLYLINE_WINDOW.
+ *  An encoder takes (LPP_POLYLINE_WINDOW + 2) coords plus up to 80 bytes, pushing a
+ *  coord another LPP_POLYLINE_PUSH_DEPTH coords of stack. CayenneLPP::addPolyline
+ *  keeps its encoder on the stack, worst case about 220 bytes on AVR with 32 bit
+ *  double and the default window of 16, about 680 bytes on a 64 bit host with 32.
+ *  CayenneLPPPolyline::begin/push/finish use this encoder on the host.
+ *
+ *  Where double is 32 bit, as with avr-gcc, coordinates keep about 7 significant
+ *  digits. At the finest precisions positions may then be off by a step, and the
+ *  output can differ from a host with 64 bit double for the same input.
+ */
+class CayenneLPPPolylineEncoder {
+public:
+    /**
+     * @brief Precision codes, the same as CayenneLPPPolyline::Precision.
+     */
+    enum Precision : uint8_t {
+        Prec0_0001  = 227,
+        Prec0_0002  = 228,
+        Prec0_0005  = 229,
+        Prec0_001   = 230,
+        Prec0_002   = 231,
+        Prec0_005   = 232,
+        Prec0_01    = 233,
+        Prec0_02    = 234,
+        Prec0_05    = 235,
+        Prec0_1     = 236,
+        Prec0_2     = 237,
+        Prec0_5     = 238,
+        Prec1_0     = 239
+    };
+
+    /**
+     * @brief Simplifications, the same values as CayenneLPPPolyline::Simplification.
+     *  DouglasPeucker applies an online Douglas-Peucker over the last LPP_POLYLINE_WINDOW coords.
+     */
+    enum Simplification : uint8_t {
+        None = 0,
+        PerpendicularDistance = 1,
+        DouglasPeucker = 2
+    };
+
+    static constexpr double ScaleFactor = 10000.0;
+
+    /**
+     * @brief Coordinate in degrees.
+     */
+    struct Coord {
+        double lat;
+        double lon;
+    };
+
+    /**
+     * @brief begin Starts a polyline.
+     * @param out The output buffer, the polyline starts with its size byte.
+     * @param capacity The size of the output buffer. No coordinates are added once it is reached.
+     *  The size byte of the format limits polylines to 255 bytes, larger ones are for the host only.
+     * @param lat The latitude of the first coordinate.
+     * @param lon The longitude of the first coordinate.
+     * @param factor The quantization factor, 1-199 or a Precision code (see CayenneLPPPolyline::encode).
+     * @param simplification The simplification to apply to coordinates.
+     * @return true on success, false if factor or coordinate is invalid.
+     */
+    bool begin(uint8_t* out, uint16_t capacity, double lat, double lon,
+               uint8_t factor = Prec0_0001, uint8_t simplification = DouglasPeucker);
+
+    /**
+     * @brief push Adds a coordinate.
+     * @return true if added, false if the buffer is full or the coordinate is invalid.
+     */
+    bool push(double lat, double lon);
+
+    /**
+     * @brief finish Flushes held back coordinates and completes the header.
+     * @return size The polyline size, 0 if not started. Larger than the capacity if
+     *  a last jump did not fit, the polyline is then incomplete.
+     */
+    uint32_t finish();
+
+    /**
+     * @brief getFactor Returns the quantization factor of a factor or Precision code, 0 if invalid.
+     */
+    static constexpr double getFactor(uint8_t factor) {
+        return factor == 0 ? 0.0
+             : factor < 200 ? factor
+             : (factor >= Prec0_0001 && factor <= Prec1_0) ? s_precisions[factor - Prec0_0001]
+             : 0.0;
+    }
+
+    /**
+     * @brief walk Moves from the previous coord to a target, both in steps of the factor.
+     *  Rounding errors are carried to the next delta, so they do not add up. Deltas
+     *  the step function does not take are split into intermediates of at most 7 steps.
+     *  Shared by this encoder and CayenneLPPPolyline::push.
+     * @param lat The latitude of the target in steps.
+     * @param lon The longitude of the target in steps.
+     * @param prevLat The latitude of the previous coord, updated as deltas are taken.
+     * @param prevLon The longitude of the previous coord, updated as deltas are taken.
+     * @param errLat The latitude rounding error of the previous coord, updated likewise.
+     * @param errLon The longitude rounding error of the previous coord, updated likewise.
+     * @param step Called as step(roundLat, roundLon, dLat, dLon, target) with the rounded
+     *  and the exact delta, target is false for intermediates. Returns true if it wrote
+     *  or dropped the delta, false to split it into intermediates.
+     */
+    template <typename Step>
+    static void walk(double lat, double lon, double& prevLat, double& prevLon,
+                     double& errLat, double& errLon, Step&& step) {
+        // Coords still to reach, the original one at the bottom. An intermediate is
+        // reached before its target is tried again, so stack use does not depend on
+        // the size of a jump. Rounding errors are at most 0.5, so the first
+        // intermediate is at most 7.5 steps away and its own intermediate fits a
+        // nibble. Three levels are reachable.
+        Coord targets[LPP_POLYLINE_PUSH_DEPTH];
+        uint8_t depth = 0;
+        targets[depth++] = { lat, lon };
+
+        while (depth) {
+            const Coord& target = targets[depth-1];
+
+            // Compute delta and correct error from previous rounding
+            const double dLat = (target.lat - prevLat) + errLat;
+            const double dLon = (target.lon - prevLon) + errLon;
+
+            // Round values
+            const int32_t roundLat = lround(dLat);
+            const int32_t roundLon = lround(dLon);
+
+            if (!step(roundLat, roundLon, dLat, dLon, depth == 1)) {
+                // Push intermediate. This is a simplified solution.
+                // A more sophisticated computation can be found her: https://www.movable-type.co.uk/scripts/latlong.html
+                // Please check the Intermediate point section.
+                const double steps = fabs(dLat/7.0) > fabs(dLon/7.0) ? fabs(dLat/7.0) : fabs(dLon/7.0);
+                const double divisor = ceil(steps);
+                targets[depth++] = { prevLat + dLat / divisor, prevLon + dLon / divisor };
+                continue;
+            }
+
+            // Compute error from rounding
+            errLat = dLat - roundLat;
+            errLon = dLon - roundLon;
+
+            prevLat = target.lat;
+            prevLon = target.lon;
+            --depth;
+        }
+    }
+
+private:
+    // Quantization factors of the precision codes, indexed by factor - Prec0_0001.
+    // Codes 224-226 (0.00001, 0.000025, 0.00005) and 240-241 (2.0, 5.0) are reserved.
+    static constexpr double s_precisions[] {
+        1.0,        // 0.0001
+        2.0,        // 0.0002
+        5.0,        // 0.0005
+        10.0,       // 0.001
+        20.0,       // 0.002
+        50.0,       // 0.005
+        100.0,      // 0.01
+        200.0,      // 0.02
+        500.0,      // 0.05
+        1000.0,     // 0.1
+        2000.0,     // 0.2
+        5000.0,     // 0.5
+        10000.0,    // 1.0
+    };
+    static_assert(sizeof(s_precisions) / sizeof(s_precisions[0]) == Prec1_0 - Prec0_0001 + 1,
+                  "Precision codes and table differ");
+
+    void pushFirst(double lat, double lon);
+    void pushStream(const Coord& coord);
+    void pushScaled(double lat, double lon, bool optimize);
+    void writeHeader(int32_t lat, int32_t lon);
+    void writeDelta(int8_t lat, int8_t lon, bool optimize);
+    void put(uint32_t index, uint8_t value);
+    static double distanceSquared(const Coord& point, const Coord& lineStart, const Coord& lineEnd);
+
+    uint8_t* m_out = nullptr;
+    uint16_t m_capacity = 0;
+    uint32_t m_size = 0;
+    uint8_t m_factor = 0;
+    uint8_t m_simplification = None;
+    bool m_streaming = false;
+    uint8_t m_lastDelta = 0;
+    bool m_lastNibble = false;  ///< Last record is a nibble delta and may be merged
+
+    double m_dFactor = 0.0;
+    double m_epsilonSquared = 0.0;
+    double m_prevLat = 0.0;
+    double m_prevLon = 0.0;
+    double m_errLat = 0.0;
+    double m_errLon = 0.0;
+
+    Coord m_first;
+    Coord m_anchor;
+    Coord m_window[LPP_POLYLINE_WINDOW];
+    uint8_t m_windowSize = 0;
+};
+
+#endif // CAYENNELPPPOLYLINEENCODER_H
@@ -0,0 +1,282 @@
+/*
+ * CayenneLPP - Semtech UDP Packet Forwarder Ingestion
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+// Host only (requires POSIX sockets)
+#if !defined(ARDUINO) && !defined(IDF_VER)
+#include "CayenneLPPSemtechUdp.h"
+#include "CayenneLPPText.h"
+
+#include <chrono>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Packet forwarder protocol identifiers
+#define PF_PUSH_DATA 0x00
+#define PF_PUSH_ACK 0x01
+#define PF_PULL_DATA 0x02
+#define PF_PULL_ACK 0x04
+#define PF_HEADER_SIZE 12
+
+// LoRaWAN message types
+#define LORAWAN_UNCONFIRMED_UP 2
+#define LORAWAN_CONFIRMED_UP 4
+
+static const char* skipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p;
+    return p;
+}
+
+// Returns the end of the JSON string, array or object starting at p
+static const char* skipValue(const char* p, const char* end) {
+    int depth = 0;
+    bool string = false;
+    for (; p < end; ++p) {
+        if (string) {
+            if (*p == '\\' && p + 1 < end) ++p;
+            else if (*p == '"') string = false;
+            if (!string && depth == 0) return p + 1;
+        } else if (*p == '"') {
+            string = true;
+        } else if (*p == '{' || *p == '[') {
+            ++depth;
+        } else if (*p == '}' || *p == ']') {
+            if (depth == 0) return p;
+            if (--depth == 0) return p + 1;
+        } else if (depth == 0 && *p == ',') {
+            return p;
+        }
+    }
+    return end;
+}
+
+// Returns the value of a top level key of the JSON object [begin, end)
+static const char* findValue(const char* begin, const char* end, const char* key) {
+    const size_t keyLength = strlen(key);
+    const char* p = skipSpace(begin, end);
+    if (p == end || *p != '{') return nullptr;
+    ++p;
+    while (p < end) {
+        p = skipSpace(p, end);
+        if (p == end || *p != '"') return nullptr;
+        const char* name = p + 1;
+        p = skipValue(p, end);
+        const bool match = (p - name - 1) == static_cast<ptrdiff_t>(keyLength) && !memcmp(name, key, keyLength);
+        p = skipSpace(p, end);
+        if (p == end || *p != ':') return nullptr;
+        p = skipSpace(p + 1, end);
+        if (match) return p;
+        p = skipSpace(skipValue(p, end), end);
+        if (p == end || *p != ',') return nullptr;
+        ++p;
+    }
+    return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+CayenneLPPSemtechUdp::CayenneLPPSemtechUdp(const Handler& handler)
+    : m_handler(handler),
+      m_lpp(0) {
+}
+
+CayenneLPPSemtechUdp::~CayenneLPPSemtechUdp() {
+    close();
+}
+
+void CayenneLPPSemtechUdp::setDecryptor(const Decryptor& decryptor) {
+    m_decryptor = decryptor;
+}
+
+void CayenneLPPSemtechUdp::setDedup(CayenneLPPDedup* dedup) {
+    m_dedup = dedup;
+}
+
+bool CayenneLPPSemtechUdp::open(uint16_t port) {
+    close();
+
+    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_socket < 0) {
+        return false;
+    }
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    socklen_t addrLength = sizeof(addr);
+    if (bind(m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || getsockname(m_socket, reinterpret_cast<sockaddr*>(&addr), &addrLength) != 0) {
+        close();
+        return false;
+    }
+
+    m_port = ntohs(addr.sin_port);
+    return true;
+}
+
+void CayenneLPPSemtechUdp::close() {
+    if (m_socket >= 0) {
+        ::close(m_socket);
+    }
+    m_socket = -1;
+    m_port = 0;
+}
+
+uint16_t CayenneLPPSemtechUdp::getPort() const {
+    return m_port;
+}
+
+int CayenneLPPSemtechUdp::poll(int timeoutMs) {
+    if (m_socket < 0) {
+        return -1;
+    }
+
+    int count = 0;
+    pollfd pfd { m_socket, POLLIN, 0 };
+    while (::poll(&pfd, 1, timeoutMs) > 0) {
+        sockaddr_in from {};
+        socklen_t fromLength = sizeof(from);
+        const ssize_t size = recvfrom(m_socket, m_datagram, sizeof(m_datagram), 0,
+                                      reinterpret_cast<sockaddr*>(&from), &fromLength);
+        if (size < 0) {
+            return -1;
+        }
+
+        uint8_t ack[4];
+        size_t ackSize = 0;
+        count += process(m_datagram, size, ack, ackSize);
+        if (ackSize) {
+            sendto(m_socket, ack, ackSize, 0, reinterpret_cast<sockaddr*>(&from), fromLength);
+        }
+
+        // Drain pending datagrams without waiting again
+        timeoutMs = 0;
+    }
+
+    return count;
+}
+
+uint32_t CayenneLPPSemtechUdp::process(const uint8_t* datagram, size_t size, uint8_t* ack, size_t& ackSize) {
+    ackSize = 0;
+    if (size < 4 || (datagram[0] != 1 && datagram[0] != 2)) {
+        return 0;
+    }
+
+    if (datagram[3] == PF_PULL_DATA && size >= PF_HEADER_SIZE) {
+        ack[0] = datagram[0]; ack[1] = datagram[1]; ack[2] = datagram[2]; ack[3] = PF_PULL_ACK;
+        ackSize = 4;
+        return 0;
+    }
+
+    if (datagram[3] != PF_PUSH_DATA || size < PF_HEADER_SIZE) {
+        return 0;
+    }
+
+    ack[0] = datagram[0]; ack[1] = datagram[1]; ack[2] = datagram[2]; ack[3] = PF_PUSH_ACK;
+    ackSize = 4;
+
+    Uplink uplink;
+    for (int i = 4; i < PF_HEADER_SIZE; ++i) {
+        uplink.gatewayEui = uplink.gatewayEui << 8 | datagram[i];
+    }
+
+    // Iterate rxpk array
+    const char* json = reinterpret_cast<const char*>(datagram + PF_HEADER_SIZE);
+    const char* end = reinterpret_cast<const char*>(datagram + size);
+    // Values may be cut off at the end of the datagram
+    const char* p = findValue(json, end, "rxpk");
+    if (!p || p == end || *p != '[') {
+        return 0;
+    }
+
+    uint32_t count = 0;
+    p = skipSpace(p + 1, end);
+    while (p < end && *p == '{') {
+        const char* objectEnd = skipValue(p, end);
+        count += processRxpk(p, objectEnd, uplink);
+        p = skipSpace(objectEnd, end);
+        if (p == end || *p != ',') break;
+        p = skipSpace(p + 1, end);
+    }
+
+    return count;
+}
+
+bool CayenneLPPSemtechUdp::processRxpk(const char* begin, const char* end, Uplink& uplink) {
+    const char* tmst = findValue(begin, end, "tmst");
+    uplink.tmst = 0;
+    for (; tmst && tmst < end && *tmst >= '0' && *tmst <= '9'; ++tmst) {
+        uplink.tmst = uplink.tmst * 10 + (*tmst - '0');
+    }
+
+    const char* data = findValue(begin, end, "data");
+    if (!data || data == end || *data != '"') {
+        return false;
+    }
+    const char* dataEnd = static_cast<const char*>(memchr(data + 1, '"', end - data - 1));
+    if (!dataEnd) {
+        return false;
+    }
+
+    const int size = CayenneLPPText::base64ToBinary(data + 1, dataEnd - data - 1, m_phyPayload, sizeof(m_phyPayload));
+    // MHDR, DevAddr, FCtrl, FCnt, FPort and MIC
+    if (size < 13) {
+        return false;
+    }
+
+    const uint8_t mType = m_phyPayload[0] >> 5;
+    if (mType != LORAWAN_UNCONFIRMED_UP && mType != LORAWAN_CONFIRMED_UP) {
+        return false;
+    }
+
+    uplink.devAddr = m_phyPayload[1] | m_phyPayload[2] << 8 | m_phyPayload[3] << 16 | uint32_t(m_phyPayload[4]) << 24;
+    const uint8_t fOptsLength = m_phyPayload[5] & 0x0F;
+    uplink.fCnt = m_phyPayload[6] | m_phyPayload[7] << 8;
+
+    // FPort is absent if there is no FRMPayload, port 0 carries MAC commands
+    const int portIndex = 8 + fOptsLength;
+    if (portIndex + 1 + 4 > size || m_phyPayload[portIndex] == 0) {
+        return false;
+    }
+    uplink.fPort = m_phyPayload[portIndex];
+    uplink.payload = &m_phyPayload[portIndex + 1];
+    uplink.size = size - portIndex - 1 - 4;
+
+    if (m_decryptor && !m_decryptor(uplink.devAddr, uplink.fCnt, &m_phyPayload[portIndex + 1], uplink.size)) {
+        return false;
+    }
+
+    if (m_dedup) {
+        const uint64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        const auto result = m_dedup->decode(uplink.devAddr, uplink.fCnt, uplink.payload, uplink.size,
+                                            nowMs, &uplink.duplicate);
+        uplink.count = result->count;
+        uplink.error = result->error;
+        if (m_handler) {
+            m_handler(uplink, result->messages);
+        }
+        return true;
+    }
+
+    m_messages.clear();
+    uplink.count = m_lpp.decode(uplink.payload, uplink.size, m_messages);
+    uplink.error = m_lpp.getError();
+    uplink.duplicate = false;
+    if (m_handler) {
+        m_handler(uplink, m_messages);
+    }
+
+    return true;
+}
+
+#endif
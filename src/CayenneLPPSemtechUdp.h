@@ -0,0 +1,114 @@
+/*
+ * CayenneLPP - Semtech UDP Packet Forwarder Ingestion
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef CAYENNELPPSEMTECHUDP_H
+#define CAYENNELPPSEMTECHUDP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+
+#include "CayenneLPP.h"
+#include "CayenneLPPDedup.h"
+
+/**
+ * @brief Receives uplinks from gateways running the Semtech UDP packet forwarder
+ *  and decodes their payloads without a network server in between.
+ *
+ *  PUSH_DATA and PULL_DATA datagrams are acknowledged. Every `rxpk` entry of a
+ *  PUSH_DATA datagram is base64 decoded, parsed as LoRaWAN data uplink and its
+ *  FRMPayload is decoded as LPP. FRMPayloads are encrypted on air, so a decryptor
+ *  must be installed unless the devices under test send plain payloads.
+ */
+class CayenneLPPSemtechUdp {
+public:
+    struct Uplink {
+        uint64_t gatewayEui = 0;
+        uint32_t tmst = 0;              ///< Gateway timestamp of the rxpk entry
+        uint32_t devAddr = 0;
+        uint16_t fCnt = 0;
+        uint8_t fPort = 0;
+        const uint8_t* payload = nullptr;   ///< FRMPayload, valid during the handler call
+        uint8_t size = 0;
+        uint8_t count = 0;              ///< Number of decoded fields, 0 on error
+        uint8_t error = LPP_ERROR_OK;   ///< LPP_ERROR_* of the decoder
+        bool duplicate = false;         ///< Same frame was already received by another gateway
+    };
+
+    /**
+     * @brief Called for every decoded uplink.
+     */
+    using Handler = std::function<void(const Uplink& uplink, const std::map<uint8_t, CayenneLPPMessage>& messages)>;
+
+    /**
+     * @brief Decrypts a FRMPayload in place. Returns false to drop the uplink.
+     */
+    using Decryptor = std::function<bool(uint32_t devAddr, uint16_t fCnt, uint8_t* payload, uint8_t size)>;
+
+    CayenneLPPSemtechUdp(const Handler& handler);
+    ~CayenneLPPSemtechUdp();
+
+    CayenneLPPSemtechUdp(const CayenneLPPSemtechUdp&) = delete;
+    CayenneLPPSemtechUdp& operator=(const CayenneLPPSemtechUdp&) = delete;
+
+    void setDecryptor(const Decryptor& decryptor);
+
+    /**
+     * @brief setDedup Decodes frames received by several gateways only once.
+     *  Duplicates are still passed to the handler, flagged and with the cached messages.
+     * @param dedup The cache to use, nullptr to disable. Not owned.
+     */
+    void setDedup(CayenneLPPDedup* dedup);
+
+    /**
+     * @brief open Binds the UDP socket.
+     * @param port The UDP port, usually 1700. 0 selects an ephemeral port.
+     * @return true on success.
+     */
+    bool open(uint16_t port = 1700);
+    void close();
+
+    /**
+     * @brief getPort Returns the bound port, 0 if not open.
+     */
+    uint16_t getPort() const;
+
+    /**
+     * @brief poll Receives and processes all datagrams arriving within the timeout.
+     *  Returns as soon as the socket has no more pending datagrams.
+     * @param timeoutMs Time to wait for the first datagram.
+     * @return count The number of decoded uplinks or -1 on socket error.
+     */
+    int poll(int timeoutMs);
+
+    /**
+     * @brief process Processes one datagram, independent of the socket.
+     * @param datagram The received datagram.
+     * @param size The datagram size.
+     * @param ack Buffer of at least 4 bytes for the acknowledge.
+     * @param ackSize Set to the acknowledge size, 0 if none is due.
+     * @return count The number of decoded uplinks.
+     */
+    uint32_t process(const uint8_t* datagram, size_t size, uint8_t* ack, size_t& ackSize);
+
+private:
+    bool processRxpk(const char* begin, const char* end, Uplink& uplink);
+
+    Handler m_handler;
+    Decryptor m_decryptor;
+    CayenneLPPDedup* m_dedup = nullptr;
+    int m_socket = -1;
+    uint16_t m_port = 0;
+
+    CayenneLPP m_lpp;
+    std::map<uint8_t, CayenneLPPMessage> m_messages;
+    uint8_t m_phyPayload[256];
+    uint8_t m_datagram[65536];
+};
+
+#endif // CAYENNELPPSEMTECHUDP_H
@@ -0,0 +1,266 @@
+/*
+ * CayenneLPP - CayenneLPP Text Payload Codec
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef ARDUINO
+#include "CayenneLPPText.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CAYENNE_LPP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Maps characters to their 6 bit value, -1 for characters outside the alphabet
+struct Base64Table {
+    int8_t values[256];
+    constexpr Base64Table() : values() {
+        for (int i = 0; i < 256; ++i) values[i] = -1;
+        for (int i = 0; i < 26; ++i) {
+            values['A' + i] = i;
+            values['a' + i] = 26 + i;
+        }
+        for (int i = 0; i < 10; ++i) values['0' + i] = 52 + i;
+        values['+'] = 62;
+        values['/'] = 63;
+    }
+};
+
+static constexpr Base64Table s_base64;
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+#ifdef CAYENNE_LPP_X86_SIMD
+// Kernels convert as many whole blocks as fit and return the number of consumed
+// characters. They stop at the first block containing invalid characters and
+// leave error reporting to the scalar code. Stores are full vector width, so
+// they only run while the output has room for a full vector.
+
+// Base64 decoding as described by Wojciech Muła, "Base64 decoding with SIMD instructions"
+__attribute__((target("ssse3")))
+static size_t base64Ssse3(const char* in, size_t length, uint8_t* out, size_t maxSize) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                          0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2F);
+
+    size_t i = 0, o = 0;
+    for (; i + 16 <= length && o + 16 <= maxSize; i += 16, o += 12) {
+        __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+        const __m128i loNibbles = _mm_and_si128(str, mask2F);
+        const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()))) {
+            break;
+        }
+        const __m128i eq2F = _mm_cmpeq_epi8(str, mask2F);
+        str = _mm_add_epi8(str, _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles)));
+
+        // Merge 4 x 6 bits to 3 bytes per 32 bit lane, then pack lanes
+        const __m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140)),
+                                              _mm_set1_epi32(0x00011000));
+        const __m128i packed = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                                                      -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), packed);
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t base64Avx2(const char* in, size_t length, uint8_t* out, size_t maxSize) {
+    const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F = _mm256_set1_epi8(0x2F);
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0, o = 0;
+    for (; i + 32 <= length && o + 32 <= maxSize; i += 32, o += 24) {
+        __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+        const __m256i loNibbles = _mm256_and_si256(str, mask2F);
+        const __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()))) {
+            break;
+        }
+        const __m256i eq2F = _mm256_cmpeq_epi8(str, mask2F);
+        str = _mm256_add_epi8(str, _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles)));
+
+        const __m256i merged = _mm256_madd_epi16(_mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140)),
+                                                 _mm256_set1_epi32(0x00011000));
+        // 12 bytes per 128 bit lane, move them next to each other
+        const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, shuffle),
+                                                           _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + o), packed);
+    }
+
+    return i;
+}
+
+__attribute__((target("sse2")))
+static size_t hexSse2(const char* in, size_t length, uint8_t* out, size_t maxSize) {
+    size_t i = 0, o = 0;
+    for (; i + 16 <= length && o + 8 <= maxSize; i += 16, o += 8) {
+        const __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        // Unsigned range checks: '0'..'9' and 'a'..'f' after folding case
+        const __m128i digit = _mm_sub_epi8(str, _mm_set1_epi8('0'));
+        const __m128i alpha = _mm_sub_epi8(_mm_or_si128(str, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        const __m128i isDigit = _mm_cmpeq_epi8(_mm_subs_epu8(digit, _mm_set1_epi8(9)), _mm_setzero_si128());
+        const __m128i isAlpha = _mm_cmpeq_epi8(_mm_subs_epu8(alpha, _mm_set1_epi8(5)), _mm_setzero_si128());
+        if (_mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) != 0xFFFF) {
+            break;
+        }
+        const __m128i values = _mm_or_si128(_mm_and_si128(isDigit, digit),
+                                            _mm_and_si128(isAlpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+        // High nibble comes first
+        const __m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00FF)), 4),
+                                           _mm_srli_epi16(values, 8));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + o), _mm_packus_epi16(bytes, bytes));
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t hexAvx2(const char* in, size_t length, uint8_t* out, size_t maxSize) {
+    size_t i = 0, o = 0;
+    for (; i + 32 <= length && o + 16 <= maxSize; i += 32, o += 16) {
+        const __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        const __m256i digit = _mm256_sub_epi8(str, _mm256_set1_epi8('0'));
+        const __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(str, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        const __m256i isDigit = _mm256_cmpeq_epi8(_mm256_subs_epu8(digit, _mm256_set1_epi8(9)), _mm256_setzero_si256());
+        const __m256i isAlpha = _mm256_cmpeq_epi8(_mm256_subs_epu8(alpha, _mm256_set1_epi8(5)), _mm256_setzero_si256());
+        if (_mm256_movemask_epi8(_mm256_or_si256(isDigit, isAlpha)) != -1) {
+            break;
+        }
+        const __m256i values = _mm256_or_si256(_mm256_and_si256(isDigit, digit),
+                                               _mm256_and_si256(isAlpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+        const __m256i bytes = _mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0110));
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(bytes, bytes), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), _mm256_castsi256_si128(packed));
+    }
+
+    return i;
+}
+
+typedef size_t (*Kernel)(const char*, size_t, uint8_t*, size_t);
+
+static Kernel base64Kernel() {
+    static const Kernel kernel = []() -> Kernel {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return base64Avx2;
+        if (__builtin_cpu_supports("ssse3")) return base64Ssse3;
+        return nullptr;
+    }();
+    return kernel;
+}
+
+static Kernel hexKernel() {
+    static const Kernel kernel = []() -> Kernel {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return hexAvx2;
+        if (__builtin_cpu_supports("sse2")) return hexSse2;
+        return nullptr;
+    }();
+    return kernel;
+}
+#endif
+
+int CayenneLPPText::base64ToBinary(const char* text, size_t length, uint8_t* out, size_t maxSize) {
+    // Strip padding
+    for (int i = 0; i < 2 && length > 0 && text[length-1] == '='; ++i) {
+        --length;
+    }
+
+    const size_t size = length / 4 * 3 + (length % 4 ? length % 4 - 1 : 0);
+    if (length % 4 == 1 || size > maxSize) {
+        return -1;
+    }
+
+    size_t i = 0, o = 0;
+#ifdef CAYENNE_LPP_X86_SIMD
+    if (Kernel kernel = base64Kernel()) {
+        i = kernel(text, length, out, maxSize);
+        o = i / 4 * 3;
+    }
+#endif
+
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(text);
+    for (; i + 4 <= length; i += 4, o += 3) {
+        const int8_t a = s_base64.values[in[i]];
+        const int8_t b = s_base64.values[in[i+1]];
+        const int8_t c = s_base64.values[in[i+2]];
+        const int8_t d = s_base64.values[in[i+3]];
+        // Any -1 sets the sign bit
+        if ((a | b | c | d) < 0) {
+            return -1;
+        }
+        const uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        out[o] = v >> 16; out[o+1] = v >> 8; out[o+2] = v;
+    }
+
+    // Remaining 2 or 3 characters
+    int32_t v = 0;
+    for (size_t j = i; j < length; ++j) {
+        if (s_base64.values[in[j]] < 0) {
+            return -1;
+        }
+        v = v << 6 | s_base64.values[in[j]];
+    }
+    if (length - i == 2) {
+        out[o] = v >> 4;
+    } else if (length - i == 3) {
+        out[o] = v >> 10; out[o+1] = v >> 2;
+    }
+
+    return size;
+}
+
+int CayenneLPPText::hexToBinary(const char* text, size_t length, uint8_t* out, size_t maxSize) {
+    if (length % 2 || length / 2 > maxSize) {
+        return -1;
+    }
+
+    size_t i = 0;
+#ifdef CAYENNE_LPP_X86_SIMD
+    if (Kernel kernel = hexKernel()) {
+        i = kernel(text, length, out, maxSize);
+    }
+#endif
+
+    for (; i < length; i += 2) {
+        const int hi = hexValue(text[i]);
+        const int lo = hexValue(text[i+1]);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
+        out[i/2] = hi << 4 | lo;
+    }
+
+    return length / 2;
+}
+
+#endif
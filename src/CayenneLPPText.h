@@ -0,0 +1,42 @@
+/*
+ * CayenneLPP - CayenneLPP Text Payload Codec
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef CAYENNELPPTEXT_H
+#define CAYENNELPPTEXT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Converts text encoded payloads, as delivered by network servers and
+ *  webhooks, back to binary. Uses SSSE3/AVX2 kernels on x86 when the CPU
+ *  supports them and a scalar implementation otherwise.
+ */
+class CayenneLPPText {
+public:
+    /**
+     * @brief base64ToBinary Decodes standard base64, padded or not.
+     * @param text The base64 text (not necessarily null terminated).
+     * @param length The text length.
+     * @param out The output buffer.
+     * @param maxSize The size of the output buffer.
+     * @return size The number of decoded bytes or -1 if the text is invalid or too long.
+     */
+    static int base64ToBinary(const char* text, size_t length, uint8_t* out, size_t maxSize);
+
+    /**
+     * @brief hexToBinary Decodes a hex string (upper or lower case, no separators).
+     * @param text The hex text (not necessarily null terminated).
+     * @param length The text length.
+     * @param out The output buffer.
+     * @param maxSize The size of the output buffer.
+     * @return size The number of decoded bytes or -1 if the text is invalid or too long.
+     */
+    static int hexToBinary(const char* text, size_t length, uint8_t* out, size_t maxSize);
+};
+
+#endif // CAYENNELPPTEXT_H
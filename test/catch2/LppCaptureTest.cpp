@@ -0,0 +1,145 @@
+/*
+ * CayenneLPP - Catch2 Unit Tests
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#include <cstdio>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <CayenneLPP.h>
+#include <CayenneLPPCapture.h>
+
+TEST_CASE("Capture file round trip", "[LppCapture]") {
+    const char* path = "clpp_capture_test.bin";
+
+    CayenneLPP lpp(51);
+    CayenneLPPCaptureWriter writer(3);
+    REQUIRE(writer.open(path));
+    for (uint8_t i = 0; i < 10; ++i) {
+        lpp.reset();
+        lpp.addTemperature(1, 20.0f + i);
+        lpp.addDigitalInput(2, i);
+        REQUIRE(writer.append(1000 + i, 1600000000000ULL + i, lpp.getBuffer(), lpp.getSize()));
+    }
+    // Larger than any LPP payload
+    const std::vector<uint8_t> large(256);
+    REQUIRE_FALSE(writer.append(1010, 1600000000010ULL, large.data(), large.size()));
+    REQUIRE(writer.close());
+
+    CayenneLPPCaptureReader reader;
+    REQUIRE(reader.open(path));
+    REQUIRE(reader.getBlockCount() == 4);
+    REQUIRE(reader.getBlock(1).records == 3);
+    REQUIRE(reader.getBlock(1).firstTimestamp == 1600000000003ULL);
+    REQUIRE(reader.getBlock(3).records == 1);
+
+    CayenneLPPCaptureReader::Record record;
+    uint8_t count = 0;
+    while (reader.next(record)) {
+        std::map<uint8_t, CayenneLPPMessage> messages;
+        REQUIRE(record.deviceId == 1000U + count);
+        REQUIRE(record.timestamp == 1600000000000ULL + count);
+        REQUIRE(lpp.decode(record.payload, record.size, messages) == 2);
+        REQUIRE(messages[1].temperature == 20.0f + count);
+        REQUIRE(messages[2].digitalInput == count);
+        ++count;
+    }
+    REQUIRE(count == 10);
+
+    // Seek into the last block
+    REQUIRE(reader.seek(3));
+    REQUIRE(reader.next(record));
+    REQUIRE(record.deviceId == 1009);
+    REQUIRE_FALSE(reader.next(record));
+
+    reader.close();
+    std::remove(path);
+}
+
+TEST_CASE("Capture file rejects invalid files", "[LppCapture]") {
+    const char* path = "clpp_capture_invalid.bin";
+
+    FILE* file = fopen(path, "wb");
+    REQUIRE(file);
+    const char junk[] = "this is not a capture file";
+    fwrite(junk, 1, sizeof(junk), file);
+    fclose(file);
+
+    CayenneLPPCaptureReader reader;
+    REQUIRE_FALSE(reader.open(path));
+    REQUIRE_FALSE(reader.open("clpp_capture_missing.bin"));
+
+    std::remove(path);
+}
+
+TEST_CASE("Capture file rejects corrupted index", "[LppCapture]") {
+    const char* path = "clpp_capture_corrupted.bin";
+
+    CayenneLPP lpp(51);
+    lpp.addTemperature(1, 20.0f);
+    CayenneLPPCaptureWriter writer(2);
+    REQUIRE(writer.open(path));
+    for (uint8_t i = 0; i < 3; ++i) {
+        REQUIRE(writer.append(1000 + i, 1600000000000ULL + i, lpp.getBuffer(), lpp.getSize()));
+    }
+    REQUIRE(writer.close());
+
+    FILE* file = fopen(path, "rb");
+    REQUIRE(file);
+    std::vector<uint8_t> data;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        data.push_back(c);
+    }
+    fclose(file);
+
+    // Index offset from the trailer, little endian
+    uint64_t indexOffset = 0;
+    for (int i = 7; i >= 0; --i) {
+        indexOffset = indexOffset << 8 | data[data.size() - 16 + i];
+    }
+
+    const auto write = [&](const std::vector<uint8_t>& content) {
+        FILE* out = fopen(path, "wb");
+        REQUIRE(out);
+        fwrite(content.data(), 1, content.size(), out);
+        fclose(out);
+    };
+
+    CayenneLPPCaptureReader reader;
+    SECTION("Block offset wraps around") {
+        // 0xFFFFFFFFFFFFFFFC, the first block
+        auto corrupted = data;
+        std::fill(corrupted.begin() + indexOffset, corrupted.begin() + indexOffset + 8, 0xFF);
+        corrupted[indexOffset] = 0xFC;
+        write(corrupted);
+        REQUIRE_FALSE(reader.open(path));
+        // The file is closed again
+        REQUIRE(reader.getBlockCount() == 0);
+    }
+    SECTION("Block offset past the index") {
+        auto corrupted = data;
+        corrupted[indexOffset] = static_cast<uint8_t>(indexOffset - 4);
+        write(corrupted);
+        REQUIRE_FALSE(reader.open(path));
+        // The file is closed again
+        REQUIRE(reader.getBlockCount() == 0);
+    }
+    SECTION("Second block offset wraps around") {
+        auto corrupted = data;
+        std::fill(corrupted.begin() + indexOffset + 32, corrupted.begin() + indexOffset + 40, 0xFF);
+        write(corrupted);
+        CayenneLPPCaptureReader::Record record;
+        REQUIRE(reader.open(path));
+        REQUIRE(reader.next(record));
+        REQUIRE(reader.next(record));
+        REQUIRE_FALSE(reader.next(record));
+        REQUIRE_FALSE(reader.seek(1));
+        reader.close();
+    }
+
+    std::remove(path);
+}
@@ -0,0 +1,125 @@
+/*
+ * CayenneLPP - Catch2 Unit Tests
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#include <atomic>
+#include <thread>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <CayenneLPP.h>
+#include <CayenneLPPDedup.h>
+
+TEST_CASE("Duplicate frames are decoded once", "[LppDedup]") {
+    CayenneLPP lpp(51);
+    lpp.addVoltage(1, 3.3f);
+
+    CayenneLPPDedup dedup(64, 1000);
+    bool duplicate = true;
+    const auto first = dedup.decode(7, 100, lpp.getBuffer(), lpp.getSize(), 0, &duplicate);
+    REQUIRE_FALSE(duplicate);
+    REQUIRE(first->count == 1);
+    REQUIRE(first->messages.at(1).voltage == 3.3f);
+
+    // Copies from other gateways
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(dedup.decode(7, 100, lpp.getBuffer(), lpp.getSize(), 10 + i, &duplicate) == first);
+        REQUIRE(duplicate);
+    }
+    REQUIRE(dedup.getMisses() == 1);
+    REQUIRE(dedup.getHits() == 4);
+
+    // Different device, frame counter or payload
+    REQUIRE(dedup.decode(8, 100, lpp.getBuffer(), lpp.getSize(), 20, &duplicate) != first);
+    REQUIRE_FALSE(duplicate);
+    REQUIRE(dedup.decode(7, 101, lpp.getBuffer(), lpp.getSize(), 20, &duplicate) != first);
+    REQUIRE_FALSE(duplicate);
+    lpp.addVoltage(2, 5.0f);
+    REQUIRE(dedup.decode(7, 100, lpp.getBuffer(), lpp.getSize(), 20, &duplicate) != first);
+    REQUIRE_FALSE(duplicate);
+}
+
+TEST_CASE("Cached frames expire", "[LppDedup]") {
+    CayenneLPP lpp(51);
+    lpp.addPresence(1, 1);
+
+    CayenneLPPDedup dedup(64, 1000);
+    bool duplicate = false;
+    dedup.decode(1, 1, lpp.getBuffer(), lpp.getSize(), 0, &duplicate);
+    dedup.decode(1, 1, lpp.getBuffer(), lpp.getSize(), 999, &duplicate);
+    REQUIRE(duplicate);
+    dedup.decode(1, 1, lpp.getBuffer(), lpp.getSize(), 1000, &duplicate);
+    REQUIRE_FALSE(duplicate);
+}
+
+TEST_CASE("Cache capacity is bounded", "[LppDedup]") {
+    CayenneLPP lpp(51);
+    lpp.addPresence(1, 1);
+
+    CayenneLPPDedup dedup(128, 100000);
+    for (uint32_t fCnt = 0; fCnt < 10000; ++fCnt) {
+        dedup.decode(1, fCnt, lpp.getBuffer(), lpp.getSize(), fCnt);
+    }
+    REQUIRE(dedup.getMisses() == 10000);
+
+    // Recent frames are still cached
+    bool duplicate = false;
+    dedup.decode(1, 9999, lpp.getBuffer(), lpp.getSize(), 10000, &duplicate);
+    REQUIRE(duplicate);
+}
+
+TEST_CASE("Cache is shared between threads", "[LppDedup]") {
+    CayenneLPP lpp(51);
+    lpp.addTemperature(1, 10.0f);
+
+    CayenneLPPDedup dedup(1024, 100000);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            for (uint32_t fCnt = 0; fCnt < 500; ++fCnt) {
+                dedup.decode(3, fCnt, lpp.getBuffer(), lpp.getSize(), 0);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(dedup.getHits() + dedup.getMisses() == 2000);
+    REQUIRE(dedup.getMisses() >= 500);
+    REQUIRE(dedup.getMisses() < 2000);
+}
+
+TEST_CASE("Concurrent copies are delivered once", "[LppDedup]") {
+    CayenneLPP lpp(51);
+    lpp.addRelativeHumidity(1, 40.0f);
+
+    CayenneLPPDedup dedup(100000, 100000);
+    std::vector<std::atomic<uint32_t>> delivered(2000);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            for (uint32_t fCnt = 0; fCnt < delivered.size(); ++fCnt) {
+                bool duplicate = true;
+                dedup.decode(4, fCnt, lpp.getBuffer(), lpp.getSize(), 0, &duplicate);
+                if (!duplicate) {
+                    ++delivered[fCnt];
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool once = true;
+    for (const auto& count : delivered) {
+        once = once && count == 1;
+    }
+    REQUIRE(once);
+    REQUIRE(dedup.getMisses() == delivered.size());
+    REQUIRE(dedup.getHits() == 3 * delivered.size());
+}
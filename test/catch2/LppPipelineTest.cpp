@@ -0,0 +1,127 @@
+/*
+ * CayenneLPP - Catch2 Unit Tests
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#include <stdexcept>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <CayenneLPP.h>
+#include <CayenneLPPPipeline.h>
+
+TEST_CASE("Pipeline decodes frames in input order", "[LppPipeline]") {
+    const auto workers = GENERATE(1, 3);
+
+    // Prepare frames
+    std::vector<std::vector<uint8_t>> payloads;
+    CayenneLPP lpp(51);
+    for (uint32_t i = 0; i < 2000; ++i) {
+        lpp.reset();
+        lpp.addLuminosity(1, i);
+        lpp.addPresence(2, i % 2);
+        payloads.emplace_back(lpp.getBuffer(), lpp.getBuffer() + lpp.getSize());
+    }
+    // A broken frame must not stall the pipeline
+    payloads[100] = { 1, 0xFF, 0 };
+
+    size_t next = 0;
+    auto reader = [&](CayenneLPPPipeline::Frame& frame) {
+        if (next == payloads.size()) {
+            return false;
+        }
+        frame.deviceId = next;
+        frame.timestamp = 0;
+        frame.payload = payloads[next].data();
+        frame.size = payloads[next].size();
+        ++next;
+        return true;
+    };
+
+    uint64_t expected = 0;
+    bool inOrder = true;
+    bool decoded = true;
+    auto writer = [&](const CayenneLPPPipeline::Result& result) {
+        inOrder = inOrder && result.frame.deviceId == expected;
+        if (expected == 100) {
+            decoded = decoded && result.count == 0 && result.error == LPP_ERROR_UNKOWN_TYPE;
+        } else {
+            decoded = decoded && result.count == 2 && result.messages.at(1).luminosity == expected;
+        }
+        ++expected;
+    };
+
+    // Small queues exercise backpressure
+    CayenneLPPPipeline pipeline(workers, 4);
+    REQUIRE(pipeline.run(reader, writer) == payloads.size());
+    REQUIRE(expected == payloads.size());
+    REQUIRE(inOrder);
+    REQUIRE(decoded);
+}
+
+TEST_CASE("Pipeline handles empty input", "[LppPipeline]") {
+    CayenneLPPPipeline pipeline(2);
+    uint64_t count = 0;
+    REQUIRE(pipeline.run([](CayenneLPPPipeline::Frame&) { return false; },
+                         [&](const CayenneLPPPipeline::Result&) { ++count; }) == 0);
+    REQUIRE(count == 0);
+}
+
+TEST_CASE("Pipeline rejects oversized frames", "[LppPipeline]") {
+    std::vector<uint8_t> payload(300, 0);
+    bool read = false;
+    auto reader = [&](CayenneLPPPipeline::Frame& frame) {
+        if (read) {
+            return false;
+        }
+        frame.payload = payload.data();
+        frame.size = payload.size();
+        read = true;
+        return true;
+    };
+
+    uint8_t error = LPP_ERROR_OK;
+    CayenneLPPPipeline pipeline(2);
+    REQUIRE(pipeline.run(reader, [&](const CayenneLPPPipeline::Result& result) { error = result.error; }) == 1);
+    REQUIRE(error == LPP_ERROR_OVERFLOW);
+}
+
+TEST_CASE("Pipeline stops on exceptions", "[LppPipeline]") {
+    const auto workers = GENERATE(1, 3);
+    const uint8_t payload[] = { 1, 0, 1 };
+
+    uint32_t next = 0;
+    bool readerThrows = false;
+    auto reader = [&](CayenneLPPPipeline::Frame& frame) {
+        if (readerThrows && next == 500) {
+            throw std::runtime_error("reader");
+        }
+        frame.deviceId = next++;
+        frame.payload = payload;
+        frame.size = sizeof(payload);
+        return true;
+    };
+
+    uint32_t written = 0;
+    auto writer = [&](const CayenneLPPPipeline::Result&) {
+        if (!readerThrows && written == 100) {
+            throw std::runtime_error("writer");
+        }
+        ++written;
+    };
+
+    // Small queues keep the stages waiting on each other
+    CayenneLPPPipeline pipeline(workers, 4);
+    SECTION("Reader throws") {
+        readerThrows = true;
+        REQUIRE_THROWS_WITH(pipeline.run(reader, writer), "reader");
+        REQUIRE(written <= 500);
+    }
+    SECTION("Writer throws") {
+        REQUIRE_THROWS_WITH(pipeline.run(reader, writer), "writer");
+        REQUIRE(written == 100);
+    }
+}
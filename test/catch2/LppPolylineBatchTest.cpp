@@ -0,0 +1,70 @@
+/*
+ * CayenneLPP - Catch2 Unit Tests
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <CayenneLPPPolylineBatch.h>
+
+static std::vector<CayenneLPPPolylineBatch::Track> makeTracks(size_t count) {
+    std::vector<CayenneLPPPolylineBatch::Track> tracks(count);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < count; ++i) {
+        // Random walks of varying length, some with jumps that need intermediates
+        CayenneLPPPolyline::Point point { 48.0 + i * 0.001, 11.0 };
+        for (size_t j = 0; j < 2 + (i * 37) % 300; ++j) {
+            seed = seed * 1664525 + 1013904223;
+            const double scale = (seed & 0xFF) == 0 ? 0.01 : 0.0001;
+            point.first += (int(seed >> 28) - 8) * scale;
+            point.second += (int(seed >> 12 & 15) - 8) * scale;
+            tracks[i].push_back(point);
+        }
+    }
+    return tracks;
+}
+
+TEST_CASE("Batch encodes like a single encoder", "[LppPolylineBatch]") {
+    const auto threads = GENERATE(1, 4);
+    const auto simplification = GENERATE(CayenneLPPPolyline::None,
+                                         CayenneLPPPolyline::DouglasPeucker,
+                                         CayenneLPPPolyline::DouglasPeuckerFit);
+    const auto tracks = makeTracks(500);
+
+    CayenneLPPPolylineBatch batch(255, threads);
+    std::vector<CayenneLPPPolylineBatch::Result> results;
+    batch.encode(tracks, results, CayenneLPPPolyline::Prec0_0002, simplification, 51);
+    REQUIRE(results.size() == tracks.size());
+
+    CayenneLPPPolyline polyline(255);
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        REQUIRE(results[i].buffer == polyline.encode(tracks[i], CayenneLPPPolyline::Prec0_0002, simplification, 51));
+        const auto stats = polyline.getEncodeStats();
+        REQUIRE(results[i].stats.keptCoords == stats.keptCoords);
+        REQUIRE(results[i].stats.addedCoords == stats.addedCoords);
+        REQUIRE(results[i].stats.removedCoords == stats.removedCoords);
+    }
+}
+
+TEST_CASE("Batch reuses result buffers", "[LppPolylineBatch]") {
+    const auto tracks = makeTracks(100);
+
+    CayenneLPPPolylineBatch batch(255, 2);
+    std::vector<CayenneLPPPolylineBatch::Result> results;
+    batch.encode(tracks, results, CayenneLPPPolyline::Prec0_001);
+
+    std::vector<const uint8_t*> data;
+    for (const auto& result : results) {
+        data.push_back(result.buffer.data());
+    }
+    batch.encode(tracks, results, CayenneLPPPolyline::Prec0_001);
+    for (size_t i = 0; i < results.size(); ++i) {
+        REQUIRE(results[i].buffer.data() == data[i]);
+    }
+
+    batch.encode({}, results);
+    REQUIRE(results.empty());
+}
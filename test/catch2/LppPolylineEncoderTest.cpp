@@ -0,0 +1,133 @@
+/*
+ * CayenneLPP - Catch2 Unit Tests
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <CayenneLPP.h>
+
+static std::vector<CayenneLPPPolyline::Point> makeTrack(uint32_t seed, size_t count) {
+    // Random walk, some jumps need intermediates
+    std::vector<CayenneLPPPolyline::Point> track;
+    CayenneLPPPolyline::Point point { 48.0, 11.0 };
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        const double scale = (seed & 0x1F) == 0 ? 0.01 : 0.0001;
+        point.first += (int(seed >> 28) - 8) * scale;
+        point.second += (int(seed >> 12 & 15) - 8) * scale;
+        track.push_back(point);
+    }
+    return track;
+}
+
+TEST_CASE("Heap-free encoder matches batch encoder", "[LppPolylineEncoder]") {
+    const auto seed = GENERATE(1u, 2u, 3u);
+    const auto precision = GENERATE(CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::Prec0_0005, CayenneLPPPolyline::Prec0_01);
+    const auto simplification = GENERATE(CayenneLPPPolyline::None,
+                                         CayenneLPPPolyline::PerpendicularDistance,
+                                         CayenneLPPPolyline::DouglasPeucker);
+    const auto track = makeTrack(seed, 400);
+
+    std::vector<uint8_t> buffer(4096);
+    CayenneLPPPolylineEncoder encoder;
+    REQUIRE(encoder.begin(buffer.data(), buffer.size(), track.front().first, track.front().second, precision, simplification));
+    for (const auto& coord : track) {
+        REQUIRE(encoder.push(coord.first, coord.second));
+    }
+    buffer.resize(encoder.finish());
+
+    // The window of the online Douglas-Peucker differs from the batch one
+    CayenneLPPPolyline polyline(65535);
+    if (simplification != CayenneLPPPolyline::DouglasPeucker) {
+        REQUIRE(buffer == polyline.encode(track, precision, simplification));
+    } else {
+        REQUIRE(buffer.size() < polyline.encode(track, precision, CayenneLPPPolyline::None).size());
+    }
+
+    const double step = CayenneLPPPolylineEncoder::getFactor(precision) / CayenneLPPPolylineEncoder::ScaleFactor;
+    const auto out = polyline.decode(buffer);
+    REQUIRE(std::abs(out.back().first - track.back().first) <= step);
+    REQUIRE(std::abs(out.back().second - track.back().second) <= step);
+}
+
+TEST_CASE("Heap-free encoder stops at capacity", "[LppPolylineEncoder]") {
+    uint8_t buffer[16];
+    CayenneLPPPolylineEncoder encoder;
+    REQUIRE(encoder.begin(buffer, sizeof(buffer), 48.0, 11.0, CayenneLPPPolylineEncoder::Prec0_0001,
+                          CayenneLPPPolylineEncoder::None));
+    REQUIRE(encoder.push(48.0007, 11.0));
+    // A jump across the globe is not followed to its end
+    REQUIRE(encoder.push(-48.0, -169.0));
+    REQUIRE_FALSE(encoder.push(-48.0, -169.0));
+    REQUIRE(encoder.finish() == sizeof(buffer) + 1);
+
+    // The host stream reports it as empty
+    CayenneLPPPolyline polyline(16);
+    REQUIRE(polyline.begin({ 48.0, 11.0 }, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None));
+    REQUIRE(polyline.push({ 48.0007, 11.0 }));
+    REQUIRE(polyline.push({ -48.0, -169.0 }));
+    REQUIRE(polyline.finish().empty());
+}
+
+TEST_CASE("Heap-free encoder rejects invalid input", "[LppPolylineEncoder]") {
+    uint8_t buffer[64];
+    CayenneLPPPolylineEncoder encoder;
+    REQUIRE_FALSE(encoder.begin(buffer, sizeof(buffer), 91.0, 11.0));
+    REQUIRE_FALSE(encoder.begin(buffer, sizeof(buffer), 48.0, 11.0, 200));
+    REQUIRE(encoder.finish() == 0);
+
+    REQUIRE(encoder.begin(buffer, sizeof(buffer), 48.0, 11.0));
+    REQUIRE_FALSE(encoder.push(48.0, 181.0));
+    REQUIRE(encoder.push(48.0001, 11.0));
+    REQUIRE(encoder.finish() == LPP_MIN_POLYLINE_SIZE + 1);
+    REQUIRE_FALSE(encoder.push(48.0002, 11.0));
+}
+
+TEST_CASE("Add polyline without heap", "[LppPolylineEncoder]") {
+    const auto track = makeTrack(4, 300);
+    std::vector<double> latitudes;
+    std::vector<double> longitudes;
+    for (const auto& coord : track) {
+        latitudes.push_back(coord.first);
+        longitudes.push_back(coord.second);
+    }
+
+    CayenneLPP lpp(51);
+    REQUIRE(lpp.addColour(1, 2, 3, 4) == 5);
+    REQUIRE(lpp.addPolyline(2, latitudes.data(), longitudes.data(), track.size(), CayenneLPPPolylineEncoder::Prec0_002) > 5);
+    REQUIRE(lpp.getError() == LPP_ERROR_OK);
+
+    CayenneLPPPolyline polyline(51 - 5 - 2);
+    polyline.begin(track.front(), CayenneLPPPolyline::Prec0_002);
+    for (const auto& coord : track) {
+        polyline.push(coord);
+    }
+    const auto expected = polyline.decode(polyline.finish());
+
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 2);
+    REQUIRE(messages.at(2).polyline == expected);
+}
+
+TEST_CASE("Add polyline without heap checks its input", "[LppPolylineEncoder]") {
+    const double latitudes[] { 48.0, 48.001, 48.002 };
+    const double longitudes[] { 11.0, 11.001, 11.002 };
+
+    CayenneLPP lpp(12);
+    REQUIRE(lpp.addPolyline(1, latitudes, longitudes, 0) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_INVALID_VALUE);
+
+    // A far jump needs more intermediates than fit
+    const double far[] { 11.0, 11.5 };
+    REQUIRE(lpp.addPolyline(1, latitudes, far, 2) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_OVERFLOW);
+
+    // The straight track is sent as its end points
+    REQUIRE(lpp.addPolyline(1, latitudes, longitudes, 3, CayenneLPPPolylineEncoder::Prec0_001) == 11);
+    REQUIRE(lpp.addPolyline(1, latitudes, longitudes, 3) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_OVERFLOW);
+}
@@ -1496,3 +1496,938 @@ TEST_CASE("Decode polyline from message", "[LppPolyline]") {
     REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 2);
     REQUIRE(messages.at(2).polyline == coords);
 }
+
+TEST_CASE("Simplify long straight track", "[LppPolyline]") {
+    SampleData coords;
+    for (int i = 0; i < 20000; ++i) {
+        coords.push_back({ 48.0 + i * 0.00001, 11.0 + i * 0.00002 });
+    }
+
+    CayenneLPPPolyline polyline(65535);
+    auto buffer = polyline.encode(coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::DouglasPeucker);
+    auto out = polyline.decode(buffer);
+
+    // Only the end points survive, the delta in between is split into intermediates
+    REQUIRE(polyline.getEncodeStats().keptCoords == 1);
+    REQUIRE(std::abs(out.back().first - coords.back().first) <= 0.00005);
+    REQUIRE(std::abs(out.back().second - coords.back().second) <= 0.00005);
+}
+
+TEST_CASE("Visvalingam-Whyatt keeps significant points", "[LppPolyline]") {
+    const SampleData coords {
+        { 12.0, -13.0 },
+        { 12.0001, -13.0 },     // On the line
+        { 12.0002, -13.0 },
+        { 12.0003, -13.0004 },  // Peak
+        { 12.0004, -13.0 },
+        { 12.0005, -13.0 }
+    };
+
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encode(coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::VisvalingamWhyatt);
+    auto out = polyline.decode(buffer);
+
+    REQUIRE(out == SampleData { { 12.0, -13.0 }, { 12.0002, -13.0 }, { 12.0003, -13.0004 }, { 12.0004, -13.0 }, { 12.0005, -13.0 } });
+}
+
+TEST_CASE("Encode sample data with Visvalingam-Whyatt", "[LppPolyline]") {
+    const auto i = GENERATE(std::tuple<SampleData, Expectations>(sampleData1, expectations1),
+                            std::tuple<SampleData, Expectations>(sampleData2, expectations2));
+
+    CayenneLPPPolyline polyline(65535);
+    for (const auto& exp : std::get<1>(i)) {
+        const auto buffer = polyline.encode(std::get<0>(i), std::get<0>(exp), CayenneLPPPolyline::VisvalingamWhyatt);
+        const auto out = polyline.decode(buffer);
+        REQUIRE(buffer.size() < std::get<2>(exp));
+        REQUIRE(std::abs(std::get<0>(i).front().first - out.front().first) <= std::get<1>(exp) / 2.0);
+        REQUIRE(std::abs(std::get<0>(i).front().second - out.front().second) <= std::get<1>(exp) / 2.0);
+        REQUIRE(std::abs(std::get<0>(i).back().first - out.back().first) <= std::get<1>(exp) / 2.0);
+        REQUIRE(std::abs(std::get<0>(i).back().second - out.back().second) <= std::get<1>(exp) / 2.0);
+    }
+}
+
+TEST_CASE("Fit whole track into byte budget", "[LppPolyline]") {
+    const auto data = GENERATE(sampleData1, sampleData2);
+    const auto exp = GENERATE(std::make_tuple(CayenneLPPPolyline::Prec0_001, 0.001, 40u),
+                              std::make_tuple(CayenneLPPPolyline::Prec0_001, 0.001, 51u),
+                              std::make_tuple(CayenneLPPPolyline::Prec0_002, 0.002, 24u),
+                              std::make_tuple(CayenneLPPPolyline::Prec0_002, 0.002, 32u));
+    const auto maxSize = std::get<2>(exp);
+
+    CayenneLPPPolyline truncating(maxSize);
+    auto truncated = truncating.decode(truncating.encode(data, std::get<0>(exp), CayenneLPPPolyline::DouglasPeucker));
+
+    CayenneLPPPolyline polyline(65535);
+    auto buffer = polyline.encode(data, std::get<0>(exp), CayenneLPPPolyline::DouglasPeuckerFit, maxSize);
+    auto out = polyline.decode(buffer);
+
+    // Budget is used up and the track still ends where the data ends
+    REQUIRE(buffer.size() <= maxSize);
+    REQUIRE(buffer.size() + 2 >= maxSize);
+    REQUIRE(std::abs(data.back().first - out.back().first) <= std::get<1>(exp) / 2.0);
+    REQUIRE(std::abs(data.back().second - out.back().second) <= std::get<1>(exp) / 2.0);
+    REQUIRE(std::abs(data.back().second - truncated.back().second) > std::get<1>(exp));
+}
+
+TEST_CASE("Fit polyline into remaining frame", "[LppPolyline]") {
+    CayenneLPP lpp(51);
+    REQUIRE(lpp.addColour(1, 2, 3, 4) == 5);
+    REQUIRE(lpp.addPolyline(2, sampleData1, CayenneLPPPolyline::Prec0_001, CayenneLPPPolyline::DouglasPeuckerFit) > 48);
+    REQUIRE(lpp.getError() == LPP_ERROR_OK);
+
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 2);
+    REQUIRE(std::abs(messages.at(2).polyline.back().first - sampleData1.back().first) <= 0.0005);
+    REQUIRE(std::abs(messages.at(2).polyline.back().second - sampleData1.back().second) <= 0.0005);
+}
+
+TEST_CASE("Select finest precision that fits", "[LppPolyline]") {
+    const auto simplification = GENERATE(CayenneLPPPolyline::None,
+                                         CayenneLPPPolyline::PerpendicularDistance,
+                                         CayenneLPPPolyline::DouglasPeucker,
+                                         CayenneLPPPolyline::VisvalingamWhyatt);
+    const auto maxSize = GENERATE(51u, 120u, 255u);
+
+    CayenneLPPPolyline polyline(65535);
+    const auto buffer = polyline.encode(sampleData1, CayenneLPPPolyline::PrecAuto, simplification, maxSize);
+    REQUIRE(buffer.size() <= maxSize);
+    REQUIRE(buffer[1] >= CayenneLPPPolyline::Prec0_0001);
+    REQUIRE(buffer[1] <= CayenneLPPPolyline::Prec1_0);
+
+    // Same output as the selected precision, and the next finer one would not fit
+    REQUIRE(polyline.encode(sampleData1, buffer[1], simplification) == buffer);
+    if (buffer[1] > CayenneLPPPolyline::Prec0_0001) {
+        REQUIRE(polyline.encode(sampleData1, buffer[1] - 1, simplification).size() > maxSize);
+    }
+}
+
+TEST_CASE("Select precision for remaining frame", "[LppPolyline]") {
+    CayenneLPP lpp(51);
+    REQUIRE(lpp.addColour(1, 2, 3, 4) == 5);
+    REQUIRE(lpp.addPolyline(2, sampleData1, CayenneLPPPolyline::PrecAuto) == 5 + 2 + 42);
+    REQUIRE(lpp.getBuffer()[8] == CayenneLPPPolyline::Prec0_002);
+}
+
+TEST_CASE("Stream coordinates", "[LppPolyline]") {
+    const auto data = GENERATE(sampleData1, sampleData2);
+    const auto simplification = GENERATE(CayenneLPPPolyline::None,
+                                         CayenneLPPPolyline::PerpendicularDistance,
+                                         CayenneLPPPolyline::DouglasPeucker);
+
+    CayenneLPPPolyline polyline(65535);
+    for (const auto& exp : expectations1) {
+        REQUIRE(polyline.begin(data.front(), std::get<0>(exp), simplification));
+        for (auto it = data.begin()+1; it != data.end(); ++it) {
+            REQUIRE(polyline.push(*it));
+        }
+        const auto buffer = polyline.finish();
+        const auto out = polyline.decode(buffer);
+        const auto encoded = polyline.encode(data, std::get<0>(exp), simplification);
+
+        // Without a window the stream matches the batch encoder
+        if (simplification != CayenneLPPPolyline::DouglasPeucker) {
+            REQUIRE(buffer == encoded);
+        } else {
+            REQUIRE(buffer.size() < polyline.encode(data, std::get<0>(exp), CayenneLPPPolyline::None).size());
+        }
+        REQUIRE(std::abs(data.back().first - out.back().first) <= std::get<1>(exp) / 2.0);
+        REQUIRE(std::abs(data.back().second - out.back().second) <= std::get<1>(exp) / 2.0);
+    }
+}
+
+TEST_CASE("Stream stops at buffer size", "[LppPolyline]") {
+    CayenneLPPPolyline polyline(16);
+    REQUIRE_FALSE(polyline.push({ 12.0, 13.0 }));
+    REQUIRE_FALSE(polyline.begin({ 12.0, 13.0 }, CayenneLPPPolyline::PrecAuto));
+    REQUIRE_FALSE(polyline.begin({ 91.0, 13.0 }));
+
+    REQUIRE(polyline.begin(sampleData1.front(), CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None));
+    size_t accepted = 0;
+    for (const auto& coord : sampleData1) {
+        accepted += polyline.push(coord);
+    }
+    REQUIRE(accepted < sampleData1.size());
+    REQUIRE(polyline.finish().size() == 16);
+    REQUIRE(polyline.finish().empty());
+}
+
+TEST_CASE("Encode into span", "[LppPolyline]") {
+    const auto simplification = GENERATE(CayenneLPPPolyline::None,
+                                         CayenneLPPPolyline::PerpendicularDistance,
+                                         CayenneLPPPolyline::DouglasPeucker,
+                                         CayenneLPPPolyline::DouglasPeuckerFit);
+
+    CayenneLPPPolyline polyline(255);
+    const auto expected = polyline.encode(sampleData2, CayenneLPPPolyline::Prec0_002, simplification);
+
+    uint8_t out[256] = {};
+    REQUIRE(polyline.encode(sampleData2, CayenneLPPPolyline::Prec0_002, simplification, out, sizeof(out)) == expected.size());
+    REQUIRE(std::vector<uint8_t>(out, out + expected.size()) == expected);
+
+    // Too small, the required size is returned and nothing is written beyond the capacity
+    std::fill(out, out + sizeof(out), 0xAA);
+    REQUIRE(polyline.encode(sampleData2, CayenneLPPPolyline::Prec0_002, simplification, out, 20) == expected.size());
+    REQUIRE(std::vector<uint8_t>(out, out + 8) != std::vector<uint8_t>(8, 0xAA));
+    REQUIRE(out[20] == 0xAA);
+}
+
+TEST_CASE("Decode span into preallocated storage", "[LppPolyline]") {
+    CayenneLPPPolyline polyline(65535);
+    const auto buffer = polyline.encode(sampleData1, CayenneLPPPolyline::Prec0_0002, CayenneLPPPolyline::None);
+    const auto expected = polyline.decode(buffer);
+
+    const auto count = CayenneLPPPolyline::getCount(buffer.data(), buffer.size());
+    REQUIRE(count == expected.size());
+    std::vector<CayenneLPPPolyline::Point> out(count);
+    REQUIRE(CayenneLPPPolyline::decode(buffer.data(), buffer.size(), out.data()) == out.data() + count);
+    REQUIRE(out == expected);
+
+    std::vector<CayenneLPPPolyline::FixedPoint> fixed(count);
+    CayenneLPPPolyline::decodeFixed(buffer.data(), buffer.size(), fixed.data());
+    for (size_t i = 0; i < count; ++i) {
+        REQUIRE(fixed[i].lat % 2 == 0);
+        REQUIRE(fixed[i].lat / CayenneLPPPolyline::ScaleFactor == expected[i].first);
+        REQUIRE(fixed[i].lon / CayenneLPPPolyline::ScaleFactor == expected[i].second);
+    }
+
+    REQUIRE(CayenneLPPPolyline::getCount(buffer.data(), 7) == 0);
+}
+
+TEST_CASE("Decode truncated polyline from message", "[LppPolyline]") {
+    CayenneLPP lpp(32);
+    REQUIRE(lpp.addPolyline(2, { { 13.0001, 12.0001 }, { 13.0002, 12.0002 }, { 13.0004, 12.0001 } }) == 12);
+
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize() - 1, messages) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_OVERFLOW);
+}
+
+TEST_CASE("Decode polyline with out of range header", "[LppPolyline]") {
+    // 8388607 degrees at the coarsest factor
+    const std::vector<uint8_t> span { 10, CayenneLPPPolyline::Prec1_0, 0x7F, 0xFF, 0xFF, 0x7F, 0xFF, 0xFF, 0x00, 0x00 };
+    REQUIRE(CayenneLPPPolyline::getCount(span.data(), span.size()) == 0);
+    REQUIRE(CayenneLPPPolyline::decode(span).empty());
+
+    // Longitude just beyond 180 degrees
+    std::vector<uint8_t> lon181 { 10, CayenneLPPPolyline::Prec1_0, 0x00, 0x00, 0x5A, 0x00, 0x00, 0xB5, 0x00, 0x00 };
+    REQUIRE(CayenneLPPPolyline::decode(lon181).empty());
+    lon181[7] = 0xB4;
+    REQUIRE(CayenneLPPPolyline::decode(lon181).size() == 3);
+
+    std::vector<uint8_t> payload { 1, LPP_POLYLINE };
+    payload.insert(payload.end(), span.begin(), span.end());
+    CayenneLPP lpp(0);
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(payload.data(), payload.size(), messages) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_INVALID_VALUE);
+}
+
+// Decoder as of before the span decoding, reference for parity
+static std::vector<CayenneLPPPolyline::Point> referenceDecode(const std::vector<uint8_t>& buffer, double dFactor) {
+    std::vector<CayenneLPPPolyline::Point> coords;
+    int32_t prevLat = static_cast<int32_t>(static_cast<uint32_t>(buffer[2] << 24 | buffer[3] << 16 | buffer[4] << 8)) / 256;
+    prevLat *= dFactor;
+    int32_t prevLon = static_cast<int32_t>(static_cast<uint32_t>(buffer[5] << 24 | buffer[6] << 16 | buffer[7] << 8)) / 256;
+    prevLon *= dFactor;
+    coords.push_back({ prevLat / 10000.0, prevLon / 10000.0 });
+    for (auto it = buffer.begin()+8; it != buffer.end(); ++it) {
+        const int8_t dLat = static_cast<int8_t>(*it << 4) >> 4;
+        const int8_t dLon = static_cast<int8_t>(*it) >> 4;
+        prevLat += static_cast<int>(dLat * dFactor);
+        prevLon += static_cast<int>(dLon * dFactor);
+        coords.push_back({ prevLat / 10000.0, prevLon / 10000.0 });
+    }
+    return coords;
+}
+
+TEST_CASE("Decode random deltas bit-exact", "[LppPolyline]") {
+    const auto factor = GENERATE(1, 7, 199, 227, 233, 239);
+    const auto size = GENERATE(8, 9, 23, 24, 25, 71, 72, 73, 255, 1000);
+    // Random header, or the first coordinate at the limits of the range
+    const auto edge = GENERATE(0, -1, 1);
+    const double dFactor = factor < 200 ? factor : std::vector<double> { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000 }.at(factor - 227);
+
+    uint32_t seed = size * 7919 + factor;
+    std::vector<uint8_t> buffer(size);
+    for (auto& b : buffer) {
+        seed = seed * 1664525 + 1013904223;
+        b = seed >> 24;
+    }
+    buffer[1] = factor;
+    // The initial coordinate must be valid, headers beyond are rejected
+    const auto header = [&](uint8_t index, double degrees) {
+        const int32_t limit = degrees * 10000 / dFactor;
+        seed = seed * 1664525 + 1013904223;
+        const int32_t value = edge ? edge * limit : static_cast<int32_t>(seed % (2 * limit + 1)) - limit;
+        buffer[index] = value >> 16; buffer[index+1] = value >> 8; buffer[index+2] = value;
+    };
+    header(2, 90.0);
+    header(5, 180.0);
+
+    REQUIRE(CayenneLPPPolyline::decode(buffer) == referenceDecode(buffer, dFactor));
+}
+
+// Recursive Douglas-Peucker on squared distances, reference for the distance kernels
+static void referenceDouglasPeucker(const SampleData& coords, size_t first, size_t last, double epsilonSquared, std::vector<bool>& keep) {
+    const double dLat = coords[last].first - coords[first].first;
+    const double dLon = coords[last].second - coords[first].second;
+    const double magSquared = dLat * dLat + dLon * dLon;
+    double dmax = 0.0;
+    size_t index = 0;
+    for (size_t i = first + 1; i < last; ++i) {
+        const double pvx = coords[i].first - coords[first].first;
+        const double pvy = coords[i].second - coords[first].second;
+        const double cross = dLat * pvy - dLon * pvx;
+        const double d = magSquared <= 0.0 ? pvx * pvx + pvy * pvy : cross * cross / magSquared;
+        if (d > dmax) {
+            index = i;
+            dmax = d;
+        }
+    }
+    if (dmax > epsilonSquared) {
+        keep[index] = true;
+        referenceDouglasPeucker(coords, first, index, epsilonSquared, keep);
+        referenceDouglasPeucker(coords, index, last, epsilonSquared, keep);
+    }
+}
+
+TEST_CASE("Simplify with ties like the reference", "[LppPolyline]") {
+    const auto amplitude = GENERATE(0.0, 0.0002, 0.0005, 0.003);
+    const auto length = GENERATE(3, 9, 10, 37, 1000);
+
+    // Zigzag with many equal distances, followed by a random walk
+    SampleData coords;
+    uint32_t seed = length;
+    for (int i = 0; i < length; ++i) {
+        coords.push_back({ 48.0 + (i % 2 ? amplitude : -amplitude), 11.0 + i * 0.0003 });
+    }
+    for (int i = 0; i < length; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        coords.push_back({ coords.back().first + (int(seed >> 28) - 8) * 0.0001, coords.back().second + (int(seed >> 4 & 15) - 8) * 0.0001 });
+    }
+
+    std::vector<bool> keep(coords.size());
+    keep.front() = keep.back() = true;
+    referenceDouglasPeucker(coords, 0, coords.size() - 1, 0.0005 * 0.0005, keep);
+    SampleData expected;
+    for (size_t i = 0; i < coords.size(); ++i) {
+        if (keep[i]) expected.push_back(coords[i]);
+    }
+
+    CayenneLPPPolyline polyline(65535);
+    REQUIRE(polyline.encode(coords, CayenneLPPPolyline::Prec0_001, CayenneLPPPolyline::DouglasPeucker)
+            == polyline.encode(expected, CayenneLPPPolyline::Prec0_001, CayenneLPPPolyline::None));
+}
+
+TEST_CASE("Huge jump is split without recursion", "[LppPolyline]") {
+    const SampleData coords {
+        { 0.0, 0.0 },
+        { 80.0, 170.0 },
+        { 80.0001, 170.0001 }
+    };
+
+    CayenneLPPPolyline polyline(1000000);
+    auto buffer = polyline.encode(coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    auto out = polyline.decode(buffer);
+
+    REQUIRE(polyline.getEncodeStats().addedCoords == 1700000 / 7);
+    REQUIRE(std::abs(out.back().first - 80.0001) <= 0.00005);
+    REQUIRE(std::abs(out.back().second - 170.0001) <= 0.00005);
+}
+
+// Highway trace, about 130 km/h sampled every 10 s along gentle curves
+static SampleData highwayTrace(uint32_t count) {
+    SampleData coords;
+    double heading = 0.3;
+    uint32_t seed = 42;
+    coords.push_back({ 48.137154, 11.576124 });
+    for (uint32_t i = 1; i < count; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        heading += ((seed >> 24) / 255.0 - 0.5) * 0.2;
+        coords.push_back({ coords.back().first + 0.0033 * std::cos(heading), coords.back().second + 0.0049 * std::sin(heading) });
+    }
+    return coords;
+}
+
+TEST_CASE("Extended format escapes large jumps", "[LppPolyline]") {
+    const SampleData coords {
+        { 48.0, 11.0 },
+        { 48.0005, 11.0003 },   // nibble
+        { 48.0105, 10.9903 },   // 8 bit
+        { 48.1105, 11.0903 },   // 12 bit
+        { 49.1105, 10.0903 },   // 24 bit
+        { 49.1104, 10.0904 }    // nibble
+    };
+
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encodeExtended(coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    REQUIRE(buffer.size() == 9 + 1 + 3 + 4 + 7 + 1);
+    REQUIRE(buffer[0] == buffer.size());
+    REQUIRE(buffer[2] == 0);
+    REQUIRE(polyline.getEncodeStats().addedCoords == 0);
+
+    auto out = polyline.decodeExtended(buffer);
+    REQUIRE(out.size() == coords.size());
+    for (size_t i = 0; i < coords.size(); ++i) {
+        REQUIRE(std::abs(out[i].first - coords[i].first) <= 0.00005);
+        REQUIRE(std::abs(out[i].second - coords[i].second) <= 0.00005);
+    }
+}
+
+TEST_CASE("Extended format saves bytes on highway traces", "[LppPolyline]") {
+    // Bytes of basic and extended format at a given precision
+    const auto sizes = GENERATE(table<CayenneLPPPolyline::Precision, uint32_t, uint32_t>({
+        { CayenneLPPPolyline::Prec0_0001, 203, 126 },
+        { CayenneLPPPolyline::Prec0_0002, 125, 126 },   // escape not shorter than intermediates
+        { CayenneLPPPolyline::Prec0_0005, 47, 48 }
+    }));
+    const auto precision = std::get<0>(sizes);
+    const auto coords = highwayTrace(40);
+
+    CayenneLPPPolyline polyline(65535);
+    const auto basic = polyline.encode(coords, precision, CayenneLPPPolyline::None);
+    const auto extended = polyline.encodeExtended(coords, precision, CayenneLPPPolyline::None);
+    REQUIRE(basic.size() == std::get<1>(sizes));
+    REQUIRE(extended.size() == std::get<2>(sizes));
+
+    // Both decode to the same track, apart from intermediates
+    const auto out = polyline.decodeExtended(extended);
+    REQUIRE(out.size() >= coords.size());
+    REQUIRE(out.back() == polyline.decode(basic).back());
+}
+
+TEST_CASE("Decode malformed extended polyline", "[LppPolyline]") {
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encodeExtended(highwayTrace(4), CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    SampleData out;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.size() == 4);
+
+    // Truncated escape
+    bool truncated = false;
+    REQUIRE_FALSE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size() - 1, out, nullptr, nullptr, nullptr, &truncated));
+    REQUIRE(truncated);
+
+    // Unknown flags
+    auto flags = buffer;
+    flags[2] = 0x80;
+    REQUIRE_FALSE(CayenneLPPPolyline::decodeExtended(flags.data(), flags.size(), out, nullptr, nullptr, nullptr, &truncated));
+    REQUIRE_FALSE(truncated);
+
+    // Reserved escape
+    auto escape = buffer;
+    escape[9] = 0x38;
+    REQUIRE_FALSE(CayenneLPPPolyline::decodeExtended(escape.data(), escape.size(), out, nullptr, nullptr, nullptr, &truncated));
+    REQUIRE_FALSE(truncated);
+
+    // No partial coordinates
+    REQUIRE(CayenneLPPPolyline::decodeExtended(std::vector<uint8_t>(buffer.begin(), buffer.end() - 1)).empty());
+    REQUIRE(CayenneLPPPolyline::decodeExtended(escape).empty());
+}
+
+TEST_CASE("Decode extended polyline from message", "[LppPolyline]") {
+    CayenneLPP lpp(64);
+    const auto coords = highwayTrace(5);
+    REQUIRE(lpp.addTemperature(1, 21.5) == 4);
+    REQUIRE(lpp.addPolylineExt(2, coords) > 4);
+
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 2);
+    REQUIRE(messages.at(2).polyline == CayenneLPPPolyline::decodeExtended(std::vector<uint8_t>(lpp.getBuffer() + 6, lpp.getBuffer() + lpp.getSize())));
+
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize() - 1, messages) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_OVERFLOW);
+
+    // Unknown flags are invalid content
+    lpp.getBuffer()[8] = 0x80;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_INVALID_VALUE);
+}
+
+TEST_CASE("Encode trajectory with times", "[LppPolyline]") {
+    CayenneLPPPolyline::Trajectory trajectory;
+    trajectory.coords = highwayTrace(20);
+    for (uint32_t i = 0; i < 20; ++i) {
+        trajectory.times.push_back(1700000000 + i * 10 + (i == 7 ? 300 : 0) + (i > 7 ? 300 : 0));
+    }
+
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encodeExtended(trajectory, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    REQUIRE(buffer[2] == LPP_POLYLINE_FLAG_TIME);
+    // Header, 8 bit escapes and one byte time deltas, two for the 310 s one
+    REQUIRE(buffer.size() == 13 + 19 * 4 + 1);
+
+    CayenneLPPPolyline::Trajectory out;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.times == trajectory.times);
+    REQUIRE(out.coords.size() == trajectory.coords.size());
+    for (size_t i = 0; i < out.coords.size(); ++i) {
+        REQUIRE(std::abs(out.coords[i].first - trajectory.coords[i].first) <= 0.00005);
+        REQUIRE(std::abs(out.coords[i].second - trajectory.coords[i].second) <= 0.00005);
+    }
+
+    // Times are ignored by the coordinate only decoder
+    REQUIRE(polyline.decodeExtended(buffer) == out.coords);
+}
+
+TEST_CASE("Synchronized simplification keeps stops", "[LppPolyline]") {
+    // Straight line at constant speed, interrupted by a stop of 5 minutes
+    CayenneLPPPolyline::Trajectory trajectory;
+    for (uint32_t i = 0; i < 30; ++i) {
+        const uint32_t moved = std::min<uint32_t>(i, 10) + (i > 20 ? i - 20 : 0);
+        trajectory.coords.push_back({ 48.0 + moved * 0.001, 11.0 + moved * 0.001 });
+        trajectory.times.push_back(1700000000 + i * 30);
+    }
+
+    CayenneLPPPolyline polyline(255);
+    const auto spatial = polyline.decodeExtended(polyline.encodeExtended(trajectory, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::DouglasPeucker));
+    REQUIRE(spatial.size() == 2);
+
+    auto buffer = polyline.encodeExtended(trajectory, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::SynchronizedDouglasPeucker);
+    CayenneLPPPolyline::Trajectory out;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.times == std::vector<uint32_t> { 1700000000, 1700000300, 1700000600, 1700000870 });
+    REQUIRE(out.coords[1] == out.coords[2]);
+}
+
+TEST_CASE("Reject trajectory with invalid times", "[LppPolyline]") {
+    CayenneLPPPolyline::Trajectory trajectory { highwayTrace(3), { 1700000000, 1700000010 }, {} };
+
+    CayenneLPPPolyline polyline(255);
+    REQUIRE(polyline.encodeExtended(trajectory).empty());
+    trajectory.times.push_back(1700000005);
+    REQUIRE(polyline.encodeExtended(trajectory).empty());
+
+    CayenneLPP lpp(64);
+    REQUIRE(lpp.addPolylineExt(1, trajectory) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_INVALID_VALUE);
+}
+
+TEST_CASE("Decode trajectory from message", "[LppPolyline]") {
+    CayenneLPPPolyline::Trajectory trajectory { highwayTrace(6), { 10, 20, 30, 200, 210, 220 }, {} };
+
+    CayenneLPP lpp(64);
+    REQUIRE(lpp.addPolylineExt(2, trajectory, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None) > 0);
+
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 1);
+    REQUIRE(messages.at(2).polyline.size() == 6);
+    REQUIRE(messages.at(2).polylineTime == trajectory.times);
+
+    // Time delta of the last coord is missing
+    lpp.getBuffer()[2] -= 1;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize() - 1, messages) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_OVERFLOW);
+}
+
+TEST_CASE("Encode trajectory with altitudes", "[LppPolyline]") {
+    // Hike up and down a ridge
+    CayenneLPPPolyline::Trajectory trajectory;
+    trajectory.coords = highwayTrace(20);
+    for (uint32_t i = 0; i < 20; ++i) {
+        trajectory.altitudes.push_back(1523.37 + (i < 10 ? i : 20 - i) * 12.34);
+    }
+
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encodeExtended(trajectory, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    REQUIRE(buffer[2] == LPP_POLYLINE_FLAG_ALTITUDE);
+    // Header, 8 bit escapes and two byte altitude deltas
+    REQUIRE(buffer.size() == 12 + 19 * 5);
+
+    CayenneLPPPolyline::Trajectory out;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.times.empty());
+    REQUIRE(out.altitudes.size() == trajectory.altitudes.size());
+    for (size_t i = 0; i < out.altitudes.size(); ++i) {
+        REQUIRE(std::abs(out.altitudes[i] - trajectory.altitudes[i]) <= 0.05 + 1e-9);
+    }
+}
+
+TEST_CASE("Simplification keeps summits", "[LppPolyline]") {
+    // Straight over a hill of 200 m
+    CayenneLPPPolyline::Trajectory trajectory;
+    for (uint32_t i = 0; i <= 20; ++i) {
+        trajectory.coords.push_back({ 48.0 + i * 0.001, 11.0 });
+        trajectory.altitudes.push_back(500.0 + (i < 10 ? i : 20 - i) * 20.0);
+    }
+
+    CayenneLPPPolyline polyline(255);
+    REQUIRE(polyline.decodeExtended(polyline.encodeExtended(trajectory.coords, CayenneLPPPolyline::Prec0_0001)).size() == 2);
+
+    const auto precision = GENERATE(CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::PrecAuto);
+    const auto simplification = GENERATE(CayenneLPPPolyline::DouglasPeucker, CayenneLPPPolyline::SynchronizedDouglasPeucker);
+    auto buffer = polyline.encodeExtended(trajectory, precision, simplification);
+    CayenneLPPPolyline::Trajectory out;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.altitudes == std::vector<double> { 500.0, 700.0, 500.0 });
+}
+
+TEST_CASE("Decode trajectory with altitudes from message", "[LppPolyline]") {
+    CayenneLPPPolyline::Trajectory trajectory { highwayTrace(4), { 10, 20, 30, 40 }, { -12.5, -3.0, 8848.8, 0.0 } };
+
+    CayenneLPP lpp(64);
+    REQUIRE(lpp.addPolylineExt(2, trajectory, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None) > 0);
+
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 1);
+    REQUIRE(messages.at(2).polylineTime == trajectory.times);
+    REQUIRE(messages.at(2).polylineAltitude == trajectory.altitudes);
+
+    // Altitude out of the 24 bit range
+    trajectory.altitudes[1] = 90000.0;
+    REQUIRE(lpp.addPolylineExt(2, trajectory) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_INVALID_VALUE);
+}
+
+TEST_CASE("Encode track segments", "[LppPolyline]") {
+    // Trip, gap in coverage, second trip nearby, single fix, third trip
+    const auto trace = highwayTrace(30);
+    const std::vector<SampleData> segments {
+        SampleData(trace.begin(), trace.begin() + 10),
+        SampleData(trace.begin() + 15, trace.begin() + 25),
+        SampleData(trace.begin() + 26, trace.begin() + 27),
+        {},
+        SampleData(trace.begin() + 27, trace.end())
+    };
+
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encodeExtended(segments, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+
+    // Break and delta instead of a field with channel, type and header
+    uint32_t separate = 0;
+    for (const auto& segment : segments) {
+        if (segment.size() > 1) {
+            separate += 2 + polyline.encodeExtended(segment, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None).size();
+        } else if (segment.size() == 1) {
+            separate += 2 + 9;
+        }
+    }
+    REQUIRE(2 + buffer.size() == 84);
+    REQUIRE(separate == 104);
+
+    std::vector<SampleData> out;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.size() == 4);
+    for (size_t s = 0, i = 0; s < segments.size(); ++s) {
+        if (segments[s].empty()) continue;
+        REQUIRE(out[i].size() == segments[s].size());
+        for (size_t j = 0; j < segments[s].size(); ++j) {
+            REQUIRE(std::abs(out[i][j].first - segments[s][j].first) <= 0.00005);
+            REQUIRE(std::abs(out[i][j].second - segments[s][j].second) <= 0.00005);
+        }
+        ++i;
+    }
+}
+
+TEST_CASE("Simplify segments independently", "[LppPolyline]") {
+    // Two collinear segments, the gap must survive any simplification
+    std::vector<SampleData> segments(2);
+    for (int i = 0; i < 10; ++i) {
+        segments[0].push_back({ 48.0 + i * 0.0005, 11.0 });
+        segments[1].push_back({ 48.01 + i * 0.0005, 11.0 });
+    }
+
+    const auto simplification = GENERATE(CayenneLPPPolyline::DouglasPeucker, CayenneLPPPolyline::VisvalingamWhyatt,
+                                         CayenneLPPPolyline::DouglasPeuckerFit);
+    const auto precision = GENERATE(CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::PrecAuto);
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encodeExtended(segments, precision, simplification, 9 + 3 + 1 + 3 + 3);
+    std::vector<SampleData> out;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.size() == 2);
+    REQUIRE(out[0].size() == 2);
+    REQUIRE(out[1].size() == 2);
+    REQUIRE(std::abs(out[0].back().first - 48.0045) <= 0.00005);
+    REQUIRE(std::abs(out[1].front().first - 48.01) <= 0.00005);
+}
+
+TEST_CASE("Decode track segments from message", "[LppPolyline]") {
+    const std::vector<SampleData> segments {
+        { { 13.0001, 12.0001 }, { 13.0002, 12.0002 } },
+        { { 13.0101, 12.0001 }, { 13.0102, 12.0002 }, { 13.0103, 12.0002 } }
+    };
+
+    CayenneLPP lpp(64);
+    REQUIRE(lpp.addPolylineExt(2, segments, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None) == 2 + 9 + 1 + 4 + 2);
+
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 1);
+    REQUIRE(messages.at(2).polyline.size() == 5);
+    REQUIRE(messages.at(2).polylineSegments == std::vector<uint32_t> { 2 });
+
+    // A basic polyline on the same channel has a single segment
+    lpp.reset();
+    REQUIRE(lpp.addPolyline(2, segments[0]) > 0);
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 1);
+    REQUIRE(messages.at(2).polylineSegments.empty());
+}
+
+TEST_CASE("Decode malformed track segments", "[LppPolyline]") {
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encodeExtended(std::vector<SampleData> { highwayTrace(2) }, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+
+    // Break without delta
+    buffer.push_back(LPP_POLYLINE_SEGMENT_BREAK);
+    std::vector<SampleData> out;
+    REQUIRE_FALSE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+
+    // Two breaks in a row
+    buffer.push_back(LPP_POLYLINE_SEGMENT_BREAK);
+    buffer.push_back(0x11);
+    REQUIRE_FALSE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+
+    buffer.erase(buffer.end() - 2);
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.size() == 2);
+    REQUIRE(out[1].size() == 1);
+}
+
+TEST_CASE("Invalid segment start ends the track", "[LppPolyline]") {
+    const std::vector<SampleData> segments {
+        { { 13.0001, 12.0001 }, { 13.0002, 12.0002 } },
+        { { 91.0, 12.0001 }, { 13.0102, 12.0002 } }
+    };
+
+    CayenneLPPPolyline polyline(255);
+    auto buffer = polyline.encodeExtended(segments, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    std::vector<SampleData> out;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), out));
+    REQUIRE(out.size() == 1);
+    REQUIRE(out[0].size() == 2);
+}
+
+TEST_CASE("Encode reports positional error", "[LppPolyline]") {
+    const auto precision = GENERATE(std::make_pair(CayenneLPPPolyline::Prec0_001, 0.001),
+                                    std::make_pair(CayenneLPPPolyline::Prec0_002, 0.002));
+    const auto coords = highwayTrace(100);
+
+    CayenneLPPPolyline polyline(65535);
+    const auto buffer = polyline.encode(coords, precision.first, CayenneLPPPolyline::None);
+    const auto stats = polyline.getEncodeStats();
+    const auto out = polyline.decode(buffer);
+    REQUIRE(out.size() == coords.size());
+
+    // Without simplification every coord is decoded on its own
+    const double lonScale = std::cos(coords.front().first * M_PI / 180.0);
+    double maxError = 0.0;
+    double maxErrorMetres = 0.0;
+    double sumSquares = 0.0;
+    for (size_t i = 0; i < out.size(); ++i) {
+        const double dLat = (coords[i].first - out[i].first) / precision.second;
+        const double dLon = (coords[i].second - out[i].second) / precision.second;
+        maxError = std::max(maxError, std::hypot(dLat, dLon));
+        maxErrorMetres = std::max(maxErrorMetres, std::hypot(dLat, dLon * lonScale) * precision.second * 111320.0);
+        sumSquares += dLat * dLat + dLon * dLon;
+    }
+
+    REQUIRE(stats.maxErrorSteps <= sqrt(0.5));
+    REQUIRE(std::abs(stats.maxErrorSteps - maxError) < 1e-6);
+    REQUIRE(std::abs(stats.maxError - maxErrorMetres) < 1e-3);
+    REQUIRE(std::abs(stats.rmsErrorSteps - sqrt(sumSquares / out.size())) < 1e-6);
+    REQUIRE(stats.compressionRatio == 6.0 * coords.size() / buffer.size());
+}
+
+TEST_CASE("Encode reports error of simplified track", "[LppPolyline]") {
+    const auto simplification = GENERATE(CayenneLPPPolyline::PerpendicularDistance,
+                                         CayenneLPPPolyline::DouglasPeucker,
+                                         CayenneLPPPolyline::VisvalingamWhyatt);
+
+    CayenneLPPPolyline polyline(65535);
+    const auto buffer = polyline.encode(sampleData2, CayenneLPPPolyline::Prec0_0005, simplification);
+    const auto stats = polyline.getEncodeStats();
+    const auto out = polyline.decode(buffer);
+
+    // Removed coords are measured against the line between their kept neighbours,
+    // intermediates may be off that line by a rounding error
+    const double step = 0.0005;
+    double maxError = 0.0;
+    for (const auto& coord : sampleData2) {
+        double error = INFINITY;
+        for (size_t i = 1; i < out.size(); ++i) {
+            const double dLat = (out[i].first - out[i-1].first) / step;
+            const double dLon = (out[i].second - out[i-1].second) / step;
+            const double pLat = (coord.first - out[i-1].first) / step;
+            const double pLon = (coord.second - out[i-1].second) / step;
+            const double magSquared = dLat * dLat + dLon * dLon;
+            const double t = magSquared > 0.0 ? std::max(0.0, std::min(1.0, (pLat * dLat + pLon * dLon) / magSquared)) : 0.0;
+            error = std::min(error, std::hypot(pLat - t * dLat, pLon - t * dLon));
+        }
+        maxError = std::max(maxError, error);
+    }
+
+    INFO("Simplification " << simplification);
+    REQUIRE(std::abs(stats.maxErrorSteps - maxError) < 0.5);
+    REQUIRE(stats.rmsErrorSteps <= stats.maxErrorSteps);
+    REQUIRE(stats.compressionRatio == 6.0 * sampleData2.size() / buffer.size());
+}
+
+TEST_CASE("Progressive simplification without budget equals Douglas-Peucker", "[LppPolyline]") {
+    const auto data = GENERATE(sampleData1, sampleData2);
+    // Douglas-Peucker only fits the whole track for PrecAuto
+    const auto exp = GENERATE(std::make_pair(CayenneLPPPolyline::Prec0_0001, 0u),
+                              std::make_pair(CayenneLPPPolyline::Prec0_001, 0u),
+                              std::make_pair(CayenneLPPPolyline::Prec0_01, 0u),
+                              std::make_pair(CayenneLPPPolyline::PrecAuto, 64u),
+                              std::make_pair(CayenneLPPPolyline::PrecAuto, 255u));
+
+    CayenneLPPPolyline polyline(65535);
+    const auto expected = polyline.encode(data, exp.first, CayenneLPPPolyline::DouglasPeucker, exp.second);
+    REQUIRE(polyline.encode(data, exp.first, CayenneLPPPolyline::ProgressiveDouglasPeucker, exp.second) == expected);
+}
+
+TEST_CASE("Progressive simplification stops at budget", "[LppPolyline]") {
+    CayenneLPPPolyline polyline(65535);
+    const auto exact = polyline.encode(sampleData2, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::ProgressiveDouglasPeucker);
+    const auto exactStats = polyline.getEncodeStats();
+
+    // A budget of about two passes over the track keeps the largest features only
+    polyline.setSimplificationBudget(2 * sampleData2.size());
+    const auto buffer = polyline.encode(sampleData2, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::ProgressiveDouglasPeucker);
+    const auto stats = polyline.getEncodeStats();
+    const auto out = polyline.decode(buffer);
+
+    REQUIRE(buffer.size() < exact.size());
+    REQUIRE(stats.maxErrorSteps > exactStats.maxErrorSteps);
+    REQUIRE(out.size() > 2);
+    REQUIRE(std::abs(sampleData2.back().first - out.back().first) <= 0.00005);
+    REQUIRE(std::abs(sampleData2.back().second - out.back().second) <= 0.00005);
+
+    // More budget refines the track
+    polyline.setSimplificationBudget(8 * sampleData2.size());
+    polyline.encode(sampleData2, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::ProgressiveDouglasPeucker);
+    REQUIRE(polyline.getEncodeStats().maxErrorSteps < stats.maxErrorSteps);
+
+    // Not even the first split fits, only the end points are encoded
+    polyline.setSimplificationBudget(1);
+    polyline.encode(sampleData2, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::ProgressiveDouglasPeucker);
+    REQUIRE(polyline.getEncodeStats().keptCoords == 1);
+}
+
+TEST_CASE("Progressive simplification fits into remaining frame", "[LppPolyline]") {
+    CayenneLPP lpp(51);
+    lpp.setPolylineBudget(4 * sampleData1.size());
+    REQUIRE(lpp.addColour(1, 2, 3, 4) == 5);
+    REQUIRE(lpp.addPolyline(2, sampleData1, CayenneLPPPolyline::PrecAuto, CayenneLPPPolyline::ProgressiveDouglasPeucker) > 5);
+    REQUIRE(lpp.getError() == LPP_ERROR_OK);
+
+    std::map<uint8_t, CayenneLPPMessage> messages;
+    REQUIRE(lpp.decode(lpp.getBuffer(), lpp.getSize(), messages) == 2);
+    // Few coords are ranked within the budget, intermediates decide the precision
+    REQUIRE(std::abs(messages.at(2).polyline.back().first - sampleData1.back().first) <= 0.0025);
+    REQUIRE(std::abs(messages.at(2).polyline.back().second - sampleData1.back().second) <= 0.0025);
+}
+
+static CayenneLPPPolyline::Trajectory parkedTrace(uint32_t count) {
+    // Fixes scattered by a few metres around a parked position, one every 10 s
+    CayenneLPPPolyline::Trajectory trajectory;
+    uint32_t seed = 7;
+    for (uint32_t i = 0; i < count; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        const double dLat = ((seed >> 16 & 0xFF) / 255.0 - 0.5) * 0.00008;
+        const double dLon = ((seed >> 24) / 255.0 - 0.5) * 0.00012;
+        trajectory.coords.push_back({ 48.137154 + dLat, 11.576124 + dLon });
+        trajectory.times.push_back(1700000000 + i * 10);
+    }
+    return trajectory;
+}
+
+TEST_CASE("Filter parked device jitter", "[LppPolyline]") {
+    const auto trajectory = parkedTrace(50);
+    CayenneLPPPolyline::Filter filter;
+    filter.stationaryRadius = 10.0;
+
+    CayenneLPPPolyline polyline(255);
+    const auto noisy = polyline.encode(trajectory.coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+
+    polyline.setFilter(filter);
+    const auto buffer = polyline.encode(trajectory.coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    const auto out = polyline.decode(buffer);
+    REQUIRE(noisy.size() > 40);
+    REQUIRE(buffer.size() == LPP_MIN_POLYLINE_SIZE);
+    REQUIRE(out.size() == 1);
+    REQUIRE(std::abs(out.front().first - 48.137154) < 0.0001);
+    REQUIRE(std::abs(out.front().second - 11.576124) < 0.0001);
+    REQUIRE(polyline.getEncodeStats().filteredCoords == 48);
+
+    // The stop is kept with its duration
+    const auto ext = polyline.encodeExtended(trajectory, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    CayenneLPPPolyline::Trajectory decoded;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(ext.data(), ext.size(), decoded));
+    REQUIRE(decoded.coords.size() == 2);
+    REQUIRE(decoded.coords.front() == decoded.coords.back());
+    REQUIRE(decoded.times == std::vector<uint32_t> { trajectory.times.front(), trajectory.times.back() });
+
+    // Disabled again
+    polyline.setFilter(CayenneLPPPolyline::Filter());
+    REQUIRE(polyline.encode(trajectory.coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None) == noisy);
+}
+
+TEST_CASE("Filter keeps a moving track", "[LppPolyline]") {
+    const auto coords = highwayTrace(40);
+    CayenneLPPPolyline::Filter filter;
+    filter.stationaryRadius = 10.0;
+    filter.maxSpeed = 1000.0;
+
+    CayenneLPPPolyline polyline(65535);
+    const auto expected = polyline.encode(coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    polyline.setFilter(filter);
+    REQUIRE(polyline.encode(coords, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None) == expected);
+    REQUIRE(polyline.getEncodeStats().filteredCoords == 0);
+}
+
+TEST_CASE("Filter drops outliers", "[LppPolyline]") {
+    // A walk at 1.4 m/s, every fix 10 s apart, with two fixes off by about 1 km
+    CayenneLPPPolyline::Trajectory trajectory;
+    for (uint32_t i = 0; i < 20; ++i) {
+        trajectory.coords.push_back({ 48.1 + i * 0.000126, 11.5 });
+        trajectory.times.push_back(1700000000 + i * 10);
+    }
+    auto noisy = trajectory;
+    noisy.coords[5].first += 0.01;
+    noisy.coords[12].second -= 0.014;
+    // The walker takes a 2 minute bus ride, which is kept
+    for (uint32_t i = 15; i < 20; ++i) {
+        noisy.coords[i].first += 0.02;
+        trajectory.coords[i].first += 0.02;
+    }
+    noisy.times[15] += 110;
+    trajectory.times[15] += 110;
+    for (uint32_t i = 16; i < 20; ++i) {
+        noisy.times[i] += 110;
+        trajectory.times[i] += 110;
+    }
+
+    CayenneLPPPolyline::Filter filter;
+    filter.maxSpeed = 30.0;
+
+    CayenneLPPPolyline polyline(255);
+    polyline.setFilter(filter);
+    const auto buffer = polyline.encodeExtended(noisy, CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+    REQUIRE(polyline.getEncodeStats().filteredCoords == 2);
+
+    CayenneLPPPolyline::Trajectory decoded;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), decoded));
+    REQUIRE(decoded.coords.size() == 18);
+    for (const auto& coord : decoded.coords) {
+        REQUIRE(std::abs(coord.second - 11.5) < 0.00005);
+    }
+    REQUIRE(std::abs(decoded.coords.back().first - trajectory.coords.back().first) < 0.00005);
+}
+
+TEST_CASE("Filter track segments separately", "[LppPolyline]") {
+    const auto parked = parkedTrace(10).coords;
+    CayenneLPPPolyline::Filter filter;
+    filter.stationaryRadius = 10.0;
+
+    CayenneLPPPolyline polyline(255);
+    polyline.setFilter(filter);
+    const auto buffer = polyline.encodeExtended(std::vector<SampleData> { parked, highwayTrace(5), parked },
+                                                CayenneLPPPolyline::Prec0_0001, CayenneLPPPolyline::None);
+
+    std::vector<SampleData> segments;
+    REQUIRE(CayenneLPPPolyline::decodeExtended(buffer.data(), buffer.size(), segments));
+    REQUIRE(segments.size() == 3);
+    REQUIRE(segments[0].size() == 1);
+    REQUIRE(segments[1].size() == 5);
+    REQUIRE(segments[2].size() == 1);
+}
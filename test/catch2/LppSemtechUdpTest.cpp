@@ -0,0 +1,203 @@
+/*
+ * CayenneLPP - Catch2 Unit Tests
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <CayenneLPPSemtechUdp.h>
+
+#include "LppTestUtils.h"
+
+// Builds an unconfirmed data uplink around the LPP payload
+static std::vector<uint8_t> makePhyPayload(uint32_t devAddr, uint16_t fCnt, CayenneLPP& lpp) {
+    std::vector<uint8_t> phy { 0x40,
+                               uint8_t(devAddr), uint8_t(devAddr >> 8), uint8_t(devAddr >> 16), uint8_t(devAddr >> 24),
+                               0x00, uint8_t(fCnt), uint8_t(fCnt >> 8), 0x01 };
+    phy.insert(phy.end(), lpp.getBuffer(), lpp.getBuffer() + lpp.getSize());
+    phy.insert(phy.end(), { 0xDE, 0xAD, 0xBE, 0xEF });
+    return phy;
+}
+
+static std::vector<uint8_t> makePushData(uint16_t token, const std::string& json) {
+    std::vector<uint8_t> datagram { 2, uint8_t(token >> 8), uint8_t(token), 0x00, 1, 2, 3, 4, 5, 6, 7, 8 };
+    datagram.insert(datagram.end(), json.begin(), json.end());
+    return datagram;
+}
+
+TEST_CASE("Semtech UDP datagrams are decoded", "[LppSemtechUdp]") {
+    std::vector<CayenneLPPSemtechUdp::Uplink> uplinks;
+    std::vector<float> temperatures;
+    CayenneLPPSemtechUdp service([&](const CayenneLPPSemtechUdp::Uplink& uplink,
+                                     const std::map<uint8_t, CayenneLPPMessage>& messages) {
+        uplinks.push_back(uplink);
+        temperatures.push_back(messages.count(3) ? messages.at(3).temperature : 0.0f);
+    });
+
+    CayenneLPP lpp(51);
+    lpp.addTemperature(3, 21.5f);
+    const std::string json = "{\"rxpk\":[{\"tmst\":3512348611,\"chan\":2,\"rfch\":0,\"freq\":866.349812,"
+                             "\"stat\":1,\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/6\",\"rssi\":-35,"
+                             "\"lsnr\":5.1,\"size\":17,\"data\":\"" + toBase64(makePhyPayload(0x26011BDA, 42, lpp)) + "\"},"
+                             " {\"tmst\":1,\"data\":\"QAEC\"}]}";
+    const auto datagram = makePushData(0x1234, json);
+
+    uint8_t ack[4];
+    size_t ackSize = 0;
+    REQUIRE(service.process(datagram.data(), datagram.size(), ack, ackSize) == 1);
+    REQUIRE(ackSize == 4);
+    REQUIRE(ack[0] == 2);
+    REQUIRE(ack[1] == 0x12);
+    REQUIRE(ack[2] == 0x34);
+    REQUIRE(ack[3] == 0x01);
+
+    REQUIRE(uplinks.size() == 1);
+    REQUIRE(uplinks[0].gatewayEui == 0x0102030405060708ULL);
+    REQUIRE(uplinks[0].tmst == 3512348611U);
+    REQUIRE(uplinks[0].devAddr == 0x26011BDA);
+    REQUIRE(uplinks[0].fCnt == 42);
+    REQUIRE(uplinks[0].fPort == 1);
+    REQUIRE(uplinks[0].count == 1);
+    REQUIRE(temperatures[0] == 21.5f);
+
+    // PULL_DATA and PUSH_DATA without rxpk are acknowledged but yield no uplinks
+    const uint8_t pull[] = { 2, 0xAB, 0xCD, 0x02, 1, 2, 3, 4, 5, 6, 7, 8 };
+    REQUIRE(service.process(pull, sizeof(pull), ack, ackSize) == 0);
+    REQUIRE(ackSize == 4);
+    REQUIRE(ack[3] == 0x04);
+    const auto stat = makePushData(1, "{\"stat\":{\"rxnb\":2}}");
+    REQUIRE(service.process(stat.data(), stat.size(), ack, ackSize) == 0);
+    REQUIRE(ackSize == 4);
+}
+
+TEST_CASE("Semtech UDP decryptor is applied", "[LppSemtechUdp]") {
+    float temperature = 0.0f;
+    CayenneLPPSemtechUdp service([&](const CayenneLPPSemtechUdp::Uplink&,
+                                     const std::map<uint8_t, CayenneLPPMessage>& messages) {
+        temperature = messages.at(1).temperature;
+    });
+    service.setDecryptor([](uint32_t, uint16_t, uint8_t* payload, uint8_t size) {
+        for (uint8_t i = 0; i < size; ++i) payload[i] ^= 0x5A;
+        return true;
+    });
+
+    CayenneLPP lpp(51);
+    lpp.addTemperature(1, -4.2f);
+    for (uint8_t i = 0; i < lpp.getSize(); ++i) lpp.getBuffer()[i] ^= 0x5A;
+    const auto datagram = makePushData(7, "{\"rxpk\":[{\"data\":\"" + toBase64(makePhyPayload(1, 1, lpp)) + "\"}]}");
+
+    uint8_t ack[4];
+    size_t ackSize = 0;
+    REQUIRE(service.process(datagram.data(), datagram.size(), ack, ackSize) == 1);
+    REQUIRE(temperature == -4.2f);
+}
+
+TEST_CASE("Semtech UDP frames from several gateways are decoded once", "[LppSemtechUdp]") {
+    std::vector<bool> duplicates;
+    CayenneLPPSemtechUdp service([&](const CayenneLPPSemtechUdp::Uplink& uplink,
+                                     const std::map<uint8_t, CayenneLPPMessage>& messages) {
+        duplicates.push_back(uplink.duplicate);
+        REQUIRE(messages.at(1).percentage == 77);
+    });
+    CayenneLPPDedup dedup;
+    service.setDedup(&dedup);
+
+    CayenneLPP lpp(51);
+    lpp.addPercentage(1, 77);
+    const auto datagram = makePushData(3, "{\"rxpk\":[{\"data\":\"" + toBase64(makePhyPayload(9, 12, lpp)) + "\"}]}");
+
+    uint8_t ack[4];
+    size_t ackSize = 0;
+    for (int gateway = 0; gateway < 3; ++gateway) {
+        REQUIRE(service.process(datagram.data(), datagram.size(), ack, ackSize) == 1);
+    }
+    REQUIRE(duplicates == std::vector<bool> { false, true, true });
+    REQUIRE(dedup.getMisses() == 1);
+}
+
+TEST_CASE("Semtech UDP rejects malformed datagrams", "[LppSemtechUdp]") {
+    uint32_t received = 0;
+    CayenneLPPSemtechUdp service([&](const CayenneLPPSemtechUdp::Uplink&,
+                                     const std::map<uint8_t, CayenneLPPMessage>&) {
+        ++received;
+    });
+
+    CayenneLPP lpp(51);
+    lpp.addTemperature(1, 12.5f);
+    const auto datagram = makePushData(5, "{\"rxpk\":[{\"tmst\":12,\"data\":\"" + toBase64(makePhyPayload(3, 4, lpp)) + "\"}]}");
+
+    uint8_t ack[4];
+    size_t ackSize = 0;
+    SECTION("Truncated datagrams") {
+        // Every prefix is copied to a buffer of its own size, reads past it are caught by ASan.
+        // The parser is lenient, a complete data string is decoded even if the JSON is cut off.
+        const size_t dataEnd = datagram.size() - 3;
+        for (size_t size = 0; size < datagram.size(); ++size) {
+            const std::vector<uint8_t> truncated(datagram.begin(), datagram.begin() + size);
+            REQUIRE(service.process(truncated.data(), truncated.size(), ack, ackSize) == (size >= dataEnd ? 1U : 0U));
+        }
+        REQUIRE(received == 3);
+    }
+    SECTION("Malformed JSON") {
+        const char* jsons[] = {
+            "", "{", "[", "\"", "{\"rxpk\"", "{\"rxpk\":", "{\"rxpk\":[", "{\"rxpk\":[{",
+            "{\"rxpk\":[{\"data\":", "{\"rxpk\":[{\"data\":\"", "{\"rxpk\":[{\"data\":\"QAEC",
+            "{\"rxpk\":[{\"data\":\"\\", "{\"rxpk\":[{\"tmst\":", "{\"rxpk\":{}}", "{\"rxpk\":[1,2]}",
+            "{\"rxpk\":[{\"data\":12}]}", "{\"rxpk\":[{\"data\":\"!!!!\"}]}", "{rxpk:[]}",
+            "{\"rxpk\":[{\"data\":\"QAEC\"}}", "{\"rxpk\":[{}}]}", "}]\"\\"
+        };
+        for (const char* json : jsons) {
+            const auto malformed = makePushData(5, json);
+            const std::vector<uint8_t> exact(malformed.begin(), malformed.end());
+            REQUIRE(service.process(exact.data(), exact.size(), ack, ackSize) == 0);
+            // Still acknowledged, the gateway must not retransmit
+            REQUIRE(ackSize == 4);
+        }
+        REQUIRE(received == 0);
+    }
+}
+
+TEST_CASE("Semtech UDP service acknowledges a local gateway", "[LppSemtechUdp]") {
+    uint32_t received = 0;
+    CayenneLPPSemtechUdp service([&](const CayenneLPPSemtechUdp::Uplink&,
+                                     const std::map<uint8_t, CayenneLPPMessage>&) {
+        ++received;
+    });
+    REQUIRE(service.open(0));
+    REQUIRE(service.getPort() != 0);
+
+    // Stand-in gateway
+    const int gateway = socket(AF_INET, SOCK_DGRAM, 0);
+    REQUIRE(gateway >= 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(service.getPort());
+
+    CayenneLPP lpp(51);
+    lpp.addPresence(1, 1);
+    const auto datagram = makePushData(0x4242, "{\"rxpk\":[{\"data\":\"" + toBase64(makePhyPayload(5, 9, lpp)) + "\"}]}");
+    REQUIRE(sendto(gateway, datagram.data(), datagram.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) > 0);
+
+    REQUIRE(service.poll(1000) == 1);
+    REQUIRE(received == 1);
+
+    timeval timeout { 1, 0 };
+    setsockopt(gateway, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    uint8_t ack[16];
+    REQUIRE(recv(gateway, ack, sizeof(ack), 0) == 4);
+    REQUIRE(ack[1] == 0x42);
+    REQUIRE(ack[3] == 0x01);
+
+    ::close(gateway);
+    service.close();
+}
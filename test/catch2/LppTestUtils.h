@@ -0,0 +1,29 @@
+/*
+ * CayenneLPP - Catch2 Unit Tests
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#ifndef LPPTESTUTILS_H
+#define LPPTESTUTILS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reference base64 encoder, standard alphabet
+inline std::string toBase64(const std::vector<uint8_t>& in, bool pad = true) {
+    static const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < in.size(); i += 3) {
+        uint32_t v = in[i] << 16 | (i + 1 < in.size() ? in[i+1] << 8 : 0) | (i + 2 < in.size() ? in[i+2] : 0);
+        out += chars[v >> 18 & 63];
+        out += chars[v >> 12 & 63];
+        if (i + 1 < in.size()) out += chars[v >> 6 & 63]; else if (pad) out += '=';
+        if (i + 2 < in.size()) out += chars[v & 63]; else if (pad) out += '=';
+    }
+    return out;
+}
+
+#endif // LPPTESTUTILS_H
@@ -0,0 +1,115 @@
+/*
+ * CayenneLPP - Catch2 Unit Tests
+ *
+ * Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+ *
+ */
+
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <CayenneLPP.h>
+#include <CayenneLPPText.h>
+
+#include "LppTestUtils.h"
+
+static std::string toHex(const std::vector<uint8_t>& in, bool upper) {
+    const char* chars = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    std::string out;
+    for (auto b : in) {
+        out += chars[b >> 4];
+        out += chars[b & 15];
+    }
+    return out;
+}
+
+static std::vector<uint8_t> makeBytes(size_t size) {
+    std::vector<uint8_t> bytes(size);
+    uint32_t seed = 12345 + size;
+    for (auto& b : bytes) {
+        seed = seed * 1103515245 + 12345;
+        b = seed >> 16;
+    }
+    return bytes;
+}
+
+TEST_CASE("Base64 text is converted", "[LppText]") {
+    for (size_t size = 0; size <= 300; ++size) {
+        const auto bytes = makeBytes(size);
+        for (bool pad : { true, false }) {
+            const auto text = toBase64(bytes, pad);
+            std::vector<uint8_t> out(size + 8);
+            REQUIRE(CayenneLPPText::base64ToBinary(text.data(), text.size(), out.data(), size) == int(size));
+            out.resize(size);
+            REQUIRE(out == bytes);
+        }
+    }
+}
+
+TEST_CASE("Invalid base64 text is rejected", "[LppText]") {
+    const auto text = toBase64(makeBytes(120));
+    std::vector<uint8_t> out(120);
+    // Every position, including those handled by vector kernels
+    for (size_t i = 0; i < text.size(); ++i) {
+        for (char c : { '-', '_', '=', ' ', '\x80', '\0' }) {
+            // A trailing '=' is padding
+            if (c == '=' && i + 1 == text.size()) continue;
+            std::string broken = text;
+            broken[i] = c;
+            REQUIRE(CayenneLPPText::base64ToBinary(broken.data(), broken.size(), out.data(), out.size()) == -1);
+        }
+    }
+    REQUIRE(CayenneLPPText::base64ToBinary(text.data(), text.size(), out.data(), 119) == -1);
+    REQUIRE(CayenneLPPText::base64ToBinary("QUJDR", 5, out.data(), out.size()) == -1);
+}
+
+TEST_CASE("Hex text is converted", "[LppText]") {
+    for (size_t size = 0; size <= 300; ++size) {
+        const auto bytes = makeBytes(size);
+        for (bool upper : { true, false }) {
+            const auto text = toHex(bytes, upper);
+            std::vector<uint8_t> out(size);
+            REQUIRE(CayenneLPPText::hexToBinary(text.data(), text.size(), out.data(), out.size()) == int(size));
+            REQUIRE(out == bytes);
+        }
+    }
+}
+
+TEST_CASE("Invalid hex text is rejected", "[LppText]") {
+    const auto text = toHex(makeBytes(80), false);
+    std::vector<uint8_t> out(80);
+    for (size_t i = 0; i < text.size(); ++i) {
+        for (char c : { 'g', 'G', '/', ':', '@', '`', ' ', '\xC1' }) {
+            std::string broken = text;
+            broken[i] = c;
+            REQUIRE(CayenneLPPText::hexToBinary(broken.data(), broken.size(), out.data(), out.size()) == -1);
+        }
+    }
+    REQUIRE(CayenneLPPText::hexToBinary("abc", 3, out.data(), out.size()) == -1);
+}
+
+TEST_CASE("Text payloads are decoded", "[LppText]") {
+    CayenneLPP lpp(51);
+    lpp.addTemperature(1, 23.4f);
+    lpp.addGPS(2, 52.3736f, 4.8865f, 2.0f);
+    const std::vector<uint8_t> payload(lpp.getBuffer(), lpp.getBuffer() + lpp.getSize());
+
+    std::map<uint8_t, CayenneLPPMessage> fromBinary, fromBase64, fromHex;
+    REQUIRE(lpp.decode(payload.data(), payload.size(), fromBinary) == 2);
+    const auto base64 = toBase64(payload);
+    REQUIRE(lpp.decodeBase64(base64.data(), base64.size(), fromBase64) == 2);
+    const auto hex = toHex(payload, true);
+    REQUIRE(lpp.decodeHex(hex.data(), hex.size(), fromHex) == 2);
+
+    REQUIRE(fromBase64.at(1).temperature == fromBinary.at(1).temperature);
+    REQUIRE(fromBase64.at(2).gps == fromBinary.at(2).gps);
+    REQUIRE(fromHex.at(1).temperature == fromBinary.at(1).temperature);
+    REQUIRE(fromHex.at(2).gps == fromBinary.at(2).gps);
+
+    REQUIRE(lpp.decodeBase64("A?==", 4, fromBase64) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_INVALID_TEXT);
+    const std::string tooLong(600, 'A');
+    REQUIRE(lpp.decodeHex(tooLong.data(), tooLong.size(), fromHex) == 0);
+    REQUIRE(lpp.getError() == LPP_ERROR_OVERFLOW);
+}